@@ -10,6 +10,39 @@ import re
 app = Flask(__name__)
 CORS(app)
 
+# 常驻的mos2json --server进程: 解析和编译的结果留在进程中, 按行收发json请求/应答
+class SimServer:
+    def __init__(self):
+        self.proc = None
+        self.lock = threading.Lock()
+        self.inputs = {}  # 设计名 -> {模块名: 输入端口列表}, 由load的应答得到
+
+    def load(self, design, file):
+        reply = self.request({'cmd': 'load', 'design': design, 'file': file})
+        if reply['ok']:
+            self.inputs[design] = {m['name']: m['inputs'] for m in reply['modules']}
+        return reply
+
+    def request(self, payload):
+        with self.lock:
+            if self.proc is None or self.proc.poll() is not None:
+                mos2json_path = os.path.join(os.getcwd(), 'mos2json.exe')
+                self.proc = subprocess.Popen(
+                    [mos2json_path, '--server'],
+                    stdin=subprocess.PIPE,
+                    stdout=subprocess.PIPE,
+                    text=True,
+                    encoding='utf-8'
+                )
+            self.proc.stdin.write(json.dumps(payload) + '\n')
+            self.proc.stdin.flush()
+            line = self.proc.stdout.readline()
+            if not line:
+                raise RuntimeError('mos2json --server已退出')
+            return json.loads(line)
+
+sim_server = SimServer()
+
 # 保存设计数据的函数
 def save_design(data):
     with open('design.json', 'w') as f:
@@ -79,8 +112,10 @@ def process_verilog(verilog_code,filename, modulename):
         if not os.path.exists(mos2json_path):
             raise FileNotFoundError(f"mos2json.exe文件不存在: {mos2json_path}")
         
+        # -i: 复用上次保存时的解析缓存, 只重新解析改动的模块
+        # -r: 超过4096行的真值表只随机抽取4096行, 输入很多的模块也能及时返回; 表中没有的输入组合由前端通过/simulate_vector仿真
         mos2json_result = subprocess.run(
-            [mos2json_path, '-f', verilog_filename, '-d', '-m'],
+            [mos2json_path, '-f', verilog_filename, '-d', '-m', '-o', '-r', '4096', '-i'],
             capture_output=True,
             text=True,
             timeout=60
@@ -93,6 +128,12 @@ def process_verilog(verilog_code,filename, modulename):
             return False, error_msg
         
         print("mos2json转换成功!")
+
+        # 在常驻进程中载入设计, 之后的单组仿真不再启动进程
+        try:
+            sim_server.load(filename, verilog_filename)
+        except Exception as e:
+            print(f"载入仿真服务失败: {str(e)}")
         
         # 运行布局布线
         json_filename = f"{filename}.v.json"
@@ -216,6 +257,33 @@ def upload_verilog():
             'message': message
         }), 500
 
+# 解析一张真值表: 表头第一行标出输入/输出列数, 第三行为端口名, 之后每行一组取值
+def parse_table(content):
+    lines = content.splitlines()
+    header_line = lines[0]
+    inout_line = lines[2]
+    inouts = [h.strip() for h in inout_line.split('|')[1:-1]]
+    
+    # 计算输入端口数量（输入列标题后连续出现的 | 数量）
+    inputs_count = header_line.count('|', header_line.index('Inputs'), header_line.index('Outputs'))
+    input_ports = inouts[:inputs_count]
+    output_ports = inouts[inputs_count:]
+    
+    # 解析表格数据
+    table = []
+    for line in lines[3:]:
+        if not line.startswith('|'):
+            continue
+        values = [v.strip() for v in line.split('|')[1:-1]]
+        if len(values) != len(inouts):
+            continue
+        
+        row = {}
+        for i, header in enumerate(inouts):
+            row[header] = values[i]
+        table.append(row)
+    return input_ports, output_ports, table
+
 # 新增路由：获取仿真数据
 @app.route('/get_simulation_data', methods=['POST'])
 def get_simulation_data():
@@ -247,32 +315,18 @@ def get_simulation_data():
             print("未找到表格")
             return jsonify({'status': 'error', 'message': 'Table not found'}), 404
         
-        # 解析表头
-        header_line = module_content.splitlines()[0]
-        
-        inout_line = module_content.splitlines()[2]
-        inouts = [h.strip() for h in inout_line.split('|')[1:-1]]
-        
-        # 计算输入端口数量（输入列标题后连续出现的 | 数量）
-        inputs_count = header_line.count('|', header_line.index('Inputs'), header_line.index('Outputs'))
-        input_ports = inouts[:inputs_count]
-        output_ports = inouts[inputs_count:]
-        
-        # 解析表格数据
-        table_lines = module_content.splitlines()[2:]
-        table = []
-        
-        for line in table_lines:
-            if not line.startswith('|'):
-                continue
-            values = [v.strip() for v in line.split('|')[1:-1]]
-            if len(values) != len(inouts):
-                continue
-            
-            row = {}
-            for i, header in enumerate(inouts):
-                row[header] = values[i]
-            table.append(row)
+        # mos2json -o 按输出锥分表: 每张表以 "### cone <输出...>" 开头, 只含该组输出依赖的输入
+        cones = []
+        if module_content.startswith('### cone'):
+            for part in re.split(r'^### cone.*$', module_content, flags=re.MULTILINE)[1:]:
+                cone_inputs, cone_outputs, cone_table = parse_table(part.strip())
+                cones.append({'input_ports': cone_inputs, 'output_ports': cone_outputs, 'table': cone_table})
+            input_ports = [p for c in cones for p in c['input_ports']]
+            input_ports = sorted(set(input_ports), key=input_ports.index)
+            output_ports = [p for c in cones for p in c['output_ports']]
+            table = []
+        else:
+            input_ports, output_ports, table = parse_table(module_content)
         print(input_ports)
         print(output_ports)
         print(table)
@@ -281,7 +335,8 @@ def get_simulation_data():
             'module_name': modulename,
             'input_ports': input_ports,
             'output_ports': output_ports,
-            'table': table
+            'table': table,
+            'cones': cones
         })
     except Exception as e:
         print(f"解析文件时出错: {str(e)}")
@@ -290,6 +345,48 @@ def get_simulation_data():
             'message': str(e)
         }), 500
 
+# 单组输入仿真: 由常驻的mos2json --server增量仿真, 不查真值表, 抽样时没有列出的输入组合也能得到结果
+# inputs为 {输入端口: '0'/'1'/'Z'/'X'}; 按输出锥分表时不影响任何输出的输入不在表中, 未给出的输入取'0'
+@app.route('/simulate_vector', methods=['POST'])
+def simulate_vector():
+    if not request.json or 'filename' not in request.json or 'inputs' not in request.json:
+        return jsonify({
+            'status': 'error',
+            'message': '无效的请求数据'
+        }), 400
+    try:
+        filename = request.json.get('filename')
+        modulename = request.json.get('modulename')
+        # 服务进程重启后设计需要重新载入
+        if filename not in sim_server.inputs:
+            sim_server.load(filename, filename + '.v')
+        inputs = dict(request.json.get('inputs'))
+        for port in sim_server.inputs.get(filename, {}).get(modulename, []):
+            inputs.setdefault(port, '0')
+        payload = {
+            'cmd': 'simulate',
+            'design': filename,
+            'module': modulename,
+            'inputs': inputs
+        }
+        reply = sim_server.request(payload)
+        if not reply['ok'] and '未载入设计' in reply['error']:
+            sim_server.load(filename, filename + '.v')
+            reply = sim_server.request(payload)
+        if not reply['ok']:
+            return jsonify({'status': 'error', 'message': reply['error']}), 500
+        return jsonify({
+            'status': 'success',
+            'module_name': payload['module'],
+            'outputs': reply['outputs']
+        })
+    except Exception as e:
+        print(f"仿真服务出错: {str(e)}")
+        return jsonify({
+            'status': 'error',
+            'message': str(e)
+        }), 500
+
 if __name__ == '__main__':   
     # 启动Flask应用
     app.run(host='0.0.0.0', port=5000, debug=True)
\ No newline at end of file
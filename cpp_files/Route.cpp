@@ -8,6 +8,7 @@
 #include <random>
 #include <algorithm>
 #include "json.hpp"
+#include "netbin.hpp"
 #include <climits>
 #include <queue>
 #include <memory>
@@ -1430,6 +1431,21 @@ void layout(shared_ptr<SubModuleNode> Module) {
     std::cout << "布局模块" << Module->module_name << "完成，大小为" << int(width) << "x" << int(height) << endl;
 }
 
+// 按元件的in/out重建comp_map、in_map、out_map
+void rebuildMaps(shared_ptr<SubModuleNode> Module) {
+    Module->comp_map.clear();
+    Module->in_map.clear();
+    Module->out_map.clear();
+
+    for (auto& comp : Module->components) {
+        Module->comp_map[comp->name] = comp;
+        for (auto& net : comp->in)
+            Module->out_map[net].push_back(comp);
+        for (auto& net : comp->out)
+            Module->in_map[net].push_back(comp);
+    }
+}
+
 // 递归读取json文件
 void getjson(json all_modules, shared_ptr<SubModuleNode> Module, string module_name) {
     json module = all_modules[module_name];
@@ -1540,17 +1556,124 @@ void getjson(json all_modules, shared_ptr<SubModuleNode> Module, string module_n
     }
 
     // 4. 重建连接映射
-    Module->comp_map.clear();
-    Module->in_map.clear();
-    Module->out_map.clear();
+    rebuildMaps(Module);
+}
 
-    for (auto& comp : Module->components) {
-        Module->comp_map[comp->name] = comp;
-        for (auto& net : comp->in)
-            Module->out_map[net].push_back(comp);
-        for (auto& net : comp->out)
-            Module->in_map[net].push_back(comp);
+// 从二进制网表(mos2json -b)递归读取, 结果与getjson相同
+// json对象按名称排序遍历, 这里同样按名称顺序处理端口、晶体管和子模块
+void getbin(const netbin::View& net, shared_ptr<SubModuleNode> Module, string module_name) {
+    long long index = net.findModule(module_name);
+    if (index < 0) return;
+    netbin::ModuleRec module = net.module(index);
+    auto sortedByName = [](uint32_t first, uint32_t count, auto nameOf) {
+        vector<uint32_t> order(count);
+        for (uint32_t i = 0; i < count; i++) order[i] = first + i;
+        sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return nameOf(a) < nameOf(b); });
+        return order;
+    };
+    auto mosName = [&](uint32_t fanout) { return string(net.str(net.mos(net.fanout(fanout)).name)); };
+
+    // 1. 处理ports
+    for (uint32_t p : sortedByName(module.firstPort, module.portCount,
+                                   [&](uint32_t i) { return net.str(net.port(i).name); })) {
+        netbin::PortRec port = net.port(p);
+        string name(net.str(port.name));
+        shared_ptr<Component> comp = make_shared<Component>();
+        comp->name = name;
+        comp->type = netbin::portTypeName(port.type);
+
+        // 记录模块输入是否加上vcc、gnd
+        if (name == "VCC")
+            Module->isvcc = true;
+        if (name == "GND")
+            Module->isgnd = true;
+        // 设置尺寸
+        if (component_sizes.find(comp->type) != component_sizes.end()) {
+            auto size = component_sizes[comp->type];
+            comp->width = size.first;
+            comp->height = size.second;
+        }
+        // 处理连接关系
+        for (uint32_t k = 0; k < port.outCount; k++)
+            comp->out.push_back(mosName(port.firstOut + k));
+        for (uint32_t k = 0; k < port.inCount; k++)
+            comp->in.push_back(mosName(port.firstIn + k));
+        if (comp->type == "input")
+            Module->inputPorts.push_back(name);
+        if (comp->type == "output")
+            Module->outputPorts.push_back(name);
+        if (comp->type == "wire")
+            Module->wirePorts.push_back(name);
+        Module->components.push_back(comp);
+        Module->comp_map[name] = comp;
+    }
+
+    // 2. 处理mosfets
+    for (uint32_t m : sortedByName(module.firstMos, module.mosCount,
+                                   [&](uint32_t i) { return net.str(net.mos(i).name); })) {
+        netbin::MosRec mos = net.mos(m);
+        string name(net.str(mos.name));
+        shared_ptr<Component> comp = make_shared<Component>();
+        comp->name = name;
+        comp->type = netbin::mosTypeName(mos.type);
+
+        // 设置MOS尺寸
+        auto size = component_sizes[comp->type];
+        comp->width = size.first;
+        comp->height = size.second;
+
+        // 创建MOS节点
+        shared_ptr<MosNode> pmos = make_shared<MosNode>();
+        pmos->gate = string(net.str(mos.gate));
+        pmos->drain = string(net.str(mos.drain));
+        pmos->source = string(net.str(mos.source));
+        comp->pMosNode = pmos;
+
+        // 设置连接关系
+        comp->in = { pmos->gate, pmos->source };
+        comp->out = { pmos->drain };
+
+        Module->components.push_back(comp);
+        Module->comp_map[name] = comp;
+        Module->mosfets.push_back(name);
     }
+
+    // 3. 处理subModules
+    for (uint32_t s : sortedByName(module.firstInst, module.instCount,
+                                   [&](uint32_t i) { return net.str(net.instance(i).name); })) {
+        netbin::InstRec inst = net.instance(s);
+        string inst_name(net.str(inst.name));
+        string module_type(net.str(inst.module));
+        long long sub = net.findModule(module_type);
+        if (sub >= 0 && net.module(sub).mosCount < MIN_MOS_NUM) continue;
+        shared_ptr<Component> comp = make_shared<Component>();
+        comp->name = inst_name;
+        comp->type = module_type;
+
+        // 设置子模块尺寸
+        comp->width = 4;  // 自定义子模块尺寸
+        comp->height = 4;
+
+        // 创建子模块节点
+        shared_ptr<SubModuleNode> psub = make_shared<SubModuleNode>();
+        comp->pSubModuleNode = psub;
+        psub->name = inst_name;
+        psub->module_name = module_type;
+
+        // 递归
+        if (sub >= 0) {
+            getbin(net, psub, module_type);
+        }
+        else {
+            cerr << "Error: Submodule definition not found: " << module_type << endl;
+        }
+
+        Module->components.push_back(comp);
+        Module->comp_map[inst_name] = comp;
+    }
+
+    // 4. 重建连接映射
+    rebuildMaps(Module);
 }
 
 // 计算两点曼哈顿距离
@@ -1979,14 +2102,24 @@ int main(int argc, char* argv[]) {
         return 0;
     }
 
-    // 读取JSON文件
-    ifstream file(filename);
-    if (!file.is_open()) {
-        cerr << "无法打开文件: " << filename << endl;
-        return 1;
-    }
+    // 读取网表: mos2json -b 输出的二进制网表直接内存映射, 否则按JSON文件读取
+    netbin::View net;
     json j;
-    file >> j;
+    bool binary = netbin::isNetbinFile(filename);
+    if (binary) {
+        if (!net.open(filename)) {
+            cerr << "无法读取二进制网表: " << filename << " " << net.error() << endl;
+            return 1;
+        }
+    }
+    else {
+        ifstream file(filename);
+        if (!file.is_open()) {
+            cerr << "无法打开文件: " << filename << endl;
+            return 1;
+        }
+        file >> j;
+    }
 
     // 获取模块名（命令行未指定则提示输入）
     if (module_name.empty()) {
@@ -1994,7 +2127,7 @@ int main(int argc, char* argv[]) {
         cin >> module_name;
     }
 
-    if (!j.contains(module_name)) {
+    if (binary ? net.findModule(module_name) < 0 : !j.contains(module_name)) {
         cerr << "模块不存在: " << module_name << endl;
         return 1;
     }
@@ -2005,7 +2138,10 @@ int main(int argc, char* argv[]) {
     root->module_name = module_name;
 
     std::cout << "处理文件中……" << endl;
-    getjson(j, root, module_name);
+    if (binary)
+        getbin(net, root, module_name);
+    else
+        getjson(j, root, module_name);
     sortModule(root);
     cout << "布局元件中……" << endl;
     layout(root);
@@ -2018,7 +2154,7 @@ int main(int argc, char* argv[]) {
 // 打印帮助信息
 void print_help() {
     cout << "=== 布线布局程序参数说明 ===\n";
-    cout << "-f <文件名>   指定输入JSON文件 (默认: adder8.v.json)\n";
+    cout << "-f <文件名>   指定输入JSON文件或二进制网表(mos2json -b) (默认: adder8.v.json)\n";
     cout << "-m <模块名>   指定要处理的模块名(默认: adder8)\n";
     cout << "-n <数量>     设置最小MOS数量 (默认: 20)\n";
     cout << "-t <步骤>     设置退火算法迭代步骤 (默认: 1000)\n";
@@ -0,0 +1,65 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// 按块分配的对象池: 对象地址在arena生命周期内不变, 不单独释放, 析构arena时一次性释放
+// 只为有非平凡析构函数的类型记录析构; 同一个arena不能被多个线程同时分配
+class Arena {
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena() {
+        for (size_t i = dtors.size(); i-- > 0;) {
+            dtors[i].destroy(dtors[i].object);
+        }
+    }
+
+    template <class T, class... Args>
+    T* make(Args&&... args) {
+        T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value) {
+            dtors.push_back({object, [](void* p) { static_cast<T*>(p)->~T(); }});
+        }
+        return object;
+    }
+
+    size_t bytes() const { return used; }
+
+private:
+    static constexpr size_t MIN_BLOCK = 16 * 1024;
+    static constexpr size_t MAX_BLOCK = 1024 * 1024;
+
+    void* allocate(size_t size, size_t align) {
+        size_t pad = (align - reinterpret_cast<uintptr_t>(cur) % align) % align;
+        if (cur == nullptr || pad + size > left) {
+            // 块大小随已用量翻倍增长, 小模块不浪费, 大模块块数少
+            size_t blockSize = std::max(size + align, std::min(MAX_BLOCK, std::max(MIN_BLOCK, used)));
+            blocks.emplace_back(new char[blockSize]);
+            cur = blocks.back().get();
+            left = blockSize;
+            pad = (align - reinterpret_cast<uintptr_t>(cur) % align) % align;
+        }
+        char* p = cur + pad;
+        cur = p + size;
+        left -= pad + size;
+        used += size;
+        return p;
+    }
+
+    struct Dtor {
+        void* object;
+        void (*destroy)(void*);
+    };
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::vector<Dtor> dtors;
+    char* cur = nullptr;
+    size_t left = 0;
+    size_t used = 0;
+};
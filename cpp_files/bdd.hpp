@@ -0,0 +1,148 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// 简化的有序二叉决策图(ROBDD)包: 节点按(变量, 低端, 高端)唯一存放在一张表中, 同一函数只有一个节点,
+// 因此两个函数相等当且仅当引用相等. 变量号小的在上层. 节点不回收, 总数超过上限时抛出异常
+class Bdd {
+public:
+    using Ref = uint32_t;
+    static constexpr Ref FALSE = 0;
+    static constexpr Ref TRUE = 1;
+
+    explicit Bdd(size_t limit = 1u << 22) : limit(limit) {
+        nodes.push_back({TERMINAL, FALSE, FALSE});
+        nodes.push_back({TERMINAL, TRUE, TRUE});
+        table.assign(1u << 12, EMPTY);
+        cache.resize(1u << 16);
+    }
+
+    // 第v个变量本身
+    Ref var(uint32_t v) { return node(v, FALSE, TRUE); }
+    Ref ite(Ref f, Ref g, Ref h) {
+        if (f == TRUE) return g;
+        if (f == FALSE) return h;
+        if (g == h) return g;
+        if (g == TRUE && h == FALSE) return f;
+        CacheEntry& e = cache[hash3(f, g, h) & (cache.size() - 1)];
+        if (e.f == f && e.g == g && e.h == h && e.result != EMPTY) return e.result;
+        uint32_t v = std::min(level(f), std::min(level(g), level(h)));
+        Ref lo = ite(cofactor(f, v, false), cofactor(g, v, false), cofactor(h, v, false));
+        Ref hi = ite(cofactor(f, v, true), cofactor(g, v, true), cofactor(h, v, true));
+        Ref r = node(v, lo, hi);
+        // 递归过程中缓存可能已扩容, 重新取表项
+        CacheEntry& slot = cache[hash3(f, g, h) & (cache.size() - 1)];
+        slot = {f, g, h, r};
+        return r;
+    }
+    Ref bnot(Ref f) { return ite(f, FALSE, TRUE); }
+    Ref band(Ref f, Ref g) { return ite(f, g, FALSE); }
+    Ref bor(Ref f, Ref g) { return ite(f, TRUE, g); }
+    Ref bxor(Ref f, Ref g) { return ite(f, bnot(g), g); }
+
+    // 变量取值values下f的值
+    bool eval(Ref f, const std::vector<uint8_t>& values) const {
+        while (f > TRUE) f = values[nodes[f].var] ? nodes[f].hi : nodes[f].lo;
+        return f == TRUE;
+    }
+    // f的一组满足赋值(路径上未出现的变量取0), f恒假时返回false
+    bool pick(Ref f, std::vector<uint8_t>& values) const {
+        if (f == FALSE) return false;
+        while (f > TRUE) {
+            bool high = nodes[f].lo == FALSE;
+            values[nodes[f].var] = high;
+            f = high ? nodes[f].hi : nodes[f].lo;
+        }
+        return true;
+    }
+    // 在vars个变量上使f为真的赋值个数(大于2^53时不精确)
+    double satCount(Ref f, uint32_t vars) const {
+        std::vector<double> fraction(nodes.size(), -1);
+        fraction[FALSE] = 0;
+        fraction[TRUE] = 1;
+        return std::ldexp(density(f, fraction), static_cast<int>(vars));
+    }
+    // 以f为根的节点数(不含终端)
+    size_t nodeCount(Ref f) const {
+        std::vector<uint8_t> seen(nodes.size(), 0);
+        std::vector<Ref> stack{f};
+        size_t count = 0;
+        while (!stack.empty()) {
+            Ref r = stack.back();
+            stack.pop_back();
+            if (r <= TRUE || seen[r]) continue;
+            seen[r] = 1;
+            count++;
+            stack.push_back(nodes[r].lo);
+            stack.push_back(nodes[r].hi);
+        }
+        return count;
+    }
+    size_t size() const { return nodes.size(); }
+
+private:
+    static constexpr uint32_t TERMINAL = UINT32_MAX;
+    static constexpr Ref EMPTY = UINT32_MAX;
+    struct Node {
+        uint32_t var;
+        Ref lo, hi;
+    };
+    struct CacheEntry {
+        Ref f = EMPTY, g = EMPTY, h = EMPTY, result = EMPTY;
+    };
+
+    static uint64_t hash3(uint32_t a, uint32_t b, uint32_t c) {
+        uint64_t h = a * 0x9E3779B97F4A7C15ull;
+        h ^= (b + 0x632BE59BD9B4E019ull + (h << 6) + (h >> 2));
+        h ^= (c + 0x85EBCA77C2B2AE63ull + (h << 6) + (h >> 2));
+        return h ^ (h >> 29);
+    }
+    uint32_t level(Ref f) const { return nodes[f].var; }
+    Ref cofactor(Ref f, uint32_t v, bool high) const {
+        if (nodes[f].var != v) return f;
+        return high ? nodes[f].hi : nodes[f].lo;
+    }
+    Ref node(uint32_t v, Ref lo, Ref hi) {
+        if (lo == hi) return lo;
+        size_t mask = table.size() - 1;
+        for (size_t i = hash3(v, lo, hi) & mask;; i = (i + 1) & mask) {
+            Ref r = table[i];
+            if (r == EMPTY) break;
+            if (nodes[r].var == v && nodes[r].lo == lo && nodes[r].hi == hi) return r;
+        }
+        if (nodes.size() >= limit) {
+            throw std::runtime_error("Error: BDD node limit (" + std::to_string(limit) + ") exceeded");
+        }
+        Ref r = static_cast<Ref>(nodes.size());
+        nodes.push_back({v, lo, hi});
+        // 装载率超过一半时扩容, 计算缓存随之变大
+        if (nodes.size() * 2 > table.size()) {
+            table.assign(table.size() * 2, EMPTY);
+            for (Ref k = TRUE + 1; k < nodes.size(); k++) insert(k);
+            if (cache.size() < table.size()) cache.assign(table.size(), CacheEntry());
+        } else {
+            insert(r);
+        }
+        return r;
+    }
+    void insert(Ref r) {
+        size_t mask = table.size() - 1;
+        size_t i = hash3(nodes[r].var, nodes[r].lo, nodes[r].hi) & mask;
+        while (table[i] != EMPTY) i = (i + 1) & mask;
+        table[i] = r;
+    }
+    double density(Ref f, std::vector<double>& fraction) const {
+        if (fraction[f] >= 0) return fraction[f];
+        double d = (density(nodes[f].lo, fraction) + density(nodes[f].hi, fraction)) / 2;
+        return fraction[f] = d;
+    }
+
+    size_t limit;
+    std::vector<Node> nodes;
+    std::vector<Ref> table;  // 唯一表, 开放寻址, 存节点下标
+    std::vector<CacheEntry> cache;  // ite的计算缓存, 直接映射, 冲突时覆盖
+};
@@ -0,0 +1,17 @@
+import sys
+# 生成一个扁平的反相器链模块, 用于词法/解析的基准测试
+# 用法: python gen_chain.py <晶体管数> > chain.v   (每级反相器2个晶体管)
+transistors = int(sys.argv[1])
+n = max(1, transistors // 2)
+out = ["module chain(a, y);", "input a;", "output y;"]
+ws = [f"w{i}" for i in range(1, n)]
+for i in range(0, len(ws), 16):
+    out.append("wire " + ", ".join(ws[i:i+16]) + ";")
+prev = "a"
+for i in range(1, n + 1):
+    cur = "y" if i == n else f"w{i}"
+    out.append(f"pmos({cur}, VCC, {prev});")
+    out.append(f"nmos({cur}, GND, {prev});")
+    prev = cur
+out.append("endmodule")
+sys.stdout.write("\n".join(out) + "\n")
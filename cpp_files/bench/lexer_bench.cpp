@@ -0,0 +1,64 @@
+// 词法分析基准: 比较原先的正则分类与现在的关键字switch+字符表分类
+// 编译: g++ -std=c++17 -O2 -pthread -o lexer_bench lexer_bench.cpp
+// 用法: python gen_chain.py 1000000 > chain.v && ./lexer_bench chain.v
+#define main mos2json_main
+#include "../mos2json_Hierarchical.cpp"
+#undef main
+#include <regex>
+
+// 改动前的分类方式
+const std::regex keywords_regex(R"(module|input|output|wire|pmos|nmos|endmodule)");
+const std::regex identifier_regex(R"([a-zA-Z_][a-zA-Z0-9_]*)");
+int regexClassify(const std::string& cur) {
+    if (std::regex_match(cur, keywords_regex)) return KEYWORD;
+    if (std::regex_match(cur, identifier_regex)) return USER_DEF;
+    return OTHER;
+}
+
+template <class F>
+double timeIt(F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "用法: " << argv[0] << " <网表文件>" << std::endl;
+        return 1;
+    }
+    MappedFile file;
+    if (!file.open(argv[1])) {
+        std::cerr << "Error:无法打开文件 " << argv[1] << std::endl;
+        return 1;
+    }
+    // 先切分出全部token, 两种分类方式在同一组token上计时
+    std::vector<std::string_view> tokens;
+    double lexSeconds = timeIt([&] {
+        Lexer lexer(file.view());
+        for (Token t = lexer.getNextToken(); !t.first.empty(); t = lexer.getNextToken()) {
+            if (t.second != SYMBOL) tokens.push_back(t.first);
+        }
+    });
+    size_t before = 0, after = 0;
+    double regexSeconds = timeIt([&] {
+        std::string cur;
+        for (auto t : tokens) {
+            cur.assign(t);
+            before += regexClassify(cur) == KEYWORD;
+        }
+    });
+    double tableSeconds = timeIt([&] {
+        for (auto t : tokens) after += classifyToken(t) == KEYWORD;
+    });
+    if (before != after) {
+        std::cerr << "Error:两种分类的关键字数不一致" << std::endl;
+        return 1;
+    }
+    auto rate = [&](double s) { return tokens.size() / s / 1e6; };
+    std::cout << "tokens: " << tokens.size() << " (关键字 " << after << ")" << std::endl;
+    std::cout << "lexer(映射+字符表): " << lexSeconds << "s, " << rate(lexSeconds) << "M tokens/s" << std::endl;
+    std::cout << "regex分类:          " << regexSeconds << "s, " << rate(regexSeconds) << "M tokens/s" << std::endl;
+    std::cout << "字符表分类:         " << tableSeconds << "s, " << rate(tableSeconds) << "M tokens/s" << std::endl;
+    return 0;
+}
@@ -0,0 +1,73 @@
+// 把二进制网表(.netbin)按 -d 输出的json格式写出, 供 roundtrip.py 比较 -b 与 -d 的结果
+// 编译: g++ -std=c++17 -O2 -o netbin_dump netbin_dump.cpp
+// 用法: ./netbin_dump design.v.netbin > design.netbin.json
+#include "../netbin.hpp"
+#include "../json.hpp"
+#include <iostream>
+
+using json = nlohmann::ordered_json;
+
+// 与ModuleNode::toJSON相同的字段和顺序
+json moduleJSON(const netbin::View& net, uint32_t i) {
+    netbin::ModuleRec m = net.module(i);
+    json j;
+    json port_j;
+    json mos_j;
+    json sub_j;
+    j["type"] = "module";
+    j["name"] = std::string(net.str(m.name));
+    for (uint32_t p = m.firstPort; p < m.firstPort + m.portCount; p++) {
+        netbin::PortRec port = net.port(p);
+        json pj;
+        pj["type"] = netbin::portTypeName(port.type);
+        for (uint32_t k = port.firstIn; k < port.firstIn + port.inCount; k++) {
+            pj["in"].push_back(std::string(net.str(net.mos(net.fanout(k)).name)));
+        }
+        for (uint32_t k = port.firstOut; k < port.firstOut + port.outCount; k++) {
+            pj["out"].push_back(std::string(net.str(net.mos(net.fanout(k)).name)));
+        }
+        port_j[std::string(net.str(port.name))] = pj;
+    }
+    for (uint32_t k = m.firstMos; k < m.firstMos + m.mosCount; k++) {
+        netbin::MosRec mos = net.mos(k);
+        json mj;
+        mj["type"] = netbin::mosTypeName(mos.type);
+        mj["drain"] = std::string(net.str(mos.drain));
+        mj["source"] = std::string(net.str(mos.source));
+        mj["gate"] = std::string(net.str(mos.gate));
+        mos_j[std::string(net.str(mos.name))] = mj;
+    }
+    for (uint32_t s = m.firstInst; s < m.firstInst + m.instCount; s++) {
+        netbin::InstRec inst = net.instance(s);
+        json sj;
+        sj["module"] = std::string(net.str(inst.module));
+        json params = json::array();
+        for (uint32_t k = inst.firstParam; k < inst.firstParam + inst.paramCount; k++) {
+            params.push_back(std::string(net.str(net.param(k))));
+        }
+        sj["parameters"] = params;
+        sub_j[std::string(net.str(inst.name))] = sj;
+    }
+    j["ports"] = port_j;
+    j["mosfets"] = mos_j;
+    j["subModules"] = sub_j;
+    return j;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: netbin_dump <file.netbin>" << std::endl;
+        return 1;
+    }
+    netbin::View net;
+    if (!net.open(argv[1])) {
+        std::cerr << "Error:" << net.error() << std::endl;
+        return 1;
+    }
+    json module_j;
+    for (uint32_t i = 0; i < net.moduleCount(); i++) {
+        module_j[std::string(net.str(net.module(i).name))] = moduleJSON(net, i);
+    }
+    std::cout << module_j.dump(4) << std::endl;
+    return 0;
+}
@@ -0,0 +1,106 @@
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+# 往返测试: -i 缓存的结果须与不用缓存的 -d 完全相同(改动一个模块后、缓存文件损坏后),
+# -b 写出的二进制网表经 netbin_dump 读回后须与 -d 的json相同
+# 用法: python roundtrip.py <mos2json可执行文件> <netbin_dump可执行文件>   (netbin_dump见netbin_dump.cpp)
+# 有不一致时输出原因并以非0退出
+exe = os.path.abspath(sys.argv[1])
+dump = os.path.abspath(sys.argv[2])
+# inv在实例化之后才定义, top依赖nand2和inv; 重复的wire产生一条警告
+design = """module top(a, b, y);
+input a, b;
+output y;
+wire w, w;
+nand2 u1(a, b, w);
+inv u2(w, y);
+endmodule
+
+module nand2(a, b, y);
+input a, b;
+output y;
+wire m;
+pmos(y, VCC, a);
+pmos(y, VCC, b);
+nmos(y, m, a);
+nmos(m, GND, b);
+endmodule
+
+module inv(a, y);
+input a;
+output y;
+pmos(y, VCC, a);
+nmos(y, GND, a);
+endmodule
+"""
+# 改动nand2: 其键改变, 实例化它的top也须重新解析, inv仍命中缓存
+edited = design.replace("nmos(m, GND, b);", "nmos(m, GND, b);\npmos(m, VCC, b);")
+failures = []
+
+
+def run(path, *args):
+    r = subprocess.run([exe, "-f", path, *args], capture_output=True, text=True, timeout=60)
+    # 去掉回显的命令行参数, 只保留警告等输出
+    out = "".join(line + "\n" for line in r.stdout.splitlines() if not line.startswith("-"))
+    with open(path + ".json") as f:
+        return r.returncode, out, f.read()
+
+
+def check(name, got, want):
+    if got != want:
+        failures.append(name)
+        print(f"FAIL {name}")
+
+
+# 按键的顺序比较, 不比较缩进等格式
+def load_json(text):
+    return json.loads(text, object_pairs_hook=list)
+
+
+def netlist(path, *args):
+    subprocess.run([exe, "-f", path, "-b", *args], stdout=subprocess.DEVNULL, timeout=60, check=True)
+    r = subprocess.run([dump, path + ".netbin"], capture_output=True, text=True, timeout=60, check=True)
+    return load_json(r.stdout)
+
+
+def corrupt(path, pos):
+    with open(path, "rb") as f:
+        data = bytearray(f.read())
+    data[pos % len(data)] ^= 0x5A
+    with open(path, "wb") as f:
+        f.write(data)
+
+
+work = tempfile.mkdtemp()
+try:
+    path = os.path.join(work, "design.v")
+    for label, text in (("原始", design), ("改动后", edited)):
+        with open(path, "w") as f:
+            f.write(text)
+        want = run(path, "-d")
+        # 第一次写缓存, 第二次全部命中
+        check(f"{label} -i -d(无缓存)", run(path, "-i", "-d"), want)
+        check(f"{label} -i -d(命中缓存)", run(path, "-i", "-d"), want)
+        check(f"{label} -b", netlist(path), load_json(want[2]))
+        check(f"{label} -i -b(命中缓存)", netlist(path, "-i"), load_json(want[2]))
+
+    # 逐段翻转缓存文件中的字节: 仍须成功并与不用缓存的结果相同, 下一次运行时缓存已重写
+    cache = path + ".cache"
+    size = os.path.getsize(cache)
+    for pos in range(0, size, max(1, size // 64)):
+        corrupt(cache, pos)
+        check(f"缓存损坏(偏移{pos})", run(path, "-i", "-d"), want)
+        check(f"缓存损坏后重写(偏移{pos})", run(path, "-i", "-d"), want)
+    with open(cache, "wb") as f:
+        f.write(b"\0" * 16)
+    check("缓存截断", run(path, "-i", "-d"), want)
+finally:
+    shutil.rmtree(work)
+
+if failures:
+    print(f"{len(failures)} 项不一致")
+    sys.exit(1)
+print("OK")
@@ -0,0 +1,18 @@
+import os
+import subprocess
+import sys
+import time
+# 解析规模测试: 生成1k~1M晶体管的反相器链, 统计 mos2json -f 的耗时(只解析, 不写json)
+# 用法: python scaling.py <mos2json可执行文件> [晶体管数 ...]
+here = os.path.dirname(os.path.abspath(__file__))
+exe = sys.argv[1]
+sizes = [int(s) for s in sys.argv[2:]] or [1000, 10000, 100000, 1000000]
+for n in sizes:
+    path = f"chain_{n}.v"
+    with open(path, "w") as f:
+        subprocess.run([sys.executable, os.path.join(here, "gen_chain.py"), str(n)], stdout=f, check=True)
+    start = time.perf_counter()
+    subprocess.run([exe, "-f", path], stdout=subprocess.DEVNULL, check=True)
+    seconds = time.perf_counter() - start
+    print(f"{n:>8} 晶体管: {seconds:.3f}s, {seconds / n * 1e9:.0f} ns/晶体管")
+    os.remove(path)
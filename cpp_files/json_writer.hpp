@@ -0,0 +1,143 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 流式json输出, 与nlohmann::json::dump(indent)逐字节一致(indent<0为不带换行缩进的紧凑格式)
+// 先写入缓冲区, 超过阈值时写到ostream; 未指定ostream时缓冲区中即为结果
+// depth为起始缩进层数, 用于生成嵌在外层对象中的片段
+class JsonWriter {
+public:
+    explicit JsonWriter(std::ostream* out = nullptr, int indent = 4, int depth = 0)
+        : out(out), indent(indent), depth(depth) {}
+    ~JsonWriter() { flush(); }
+    JsonWriter(const JsonWriter&) = delete;
+    JsonWriter& operator=(const JsonWriter&) = delete;
+
+    void beginObject() {
+        value();
+        buf += '{';
+        empty.push_back(true);
+    }
+    void endObject() { close('}'); }
+    void beginArray() {
+        value();
+        buf += '[';
+        empty.push_back(true);
+    }
+    void endArray() { close(']'); }
+    void key(std::string_view k) {
+        separator();
+        writeString(k);
+        buf += indent >= 0 ? ": " : ":";
+        afterKey = true;
+    }
+    void string(std::string_view s) {
+        value();
+        writeString(s);
+    }
+    void null() {
+        value();
+        buf += "null";
+    }
+    // 已经是同样格式(缩进层数一致)的json文本
+    void raw(std::string_view text) {
+        value();
+        buf.append(text.data(), text.size());
+        maybeFlush();
+    }
+
+    void flush() {
+        if (out != nullptr && !buf.empty()) {
+            out->write(buf.data(), buf.size());
+            buf.clear();
+        }
+    }
+    std::string& buffer() { return buf; }
+
+private:
+    static constexpr size_t FLUSH_SIZE = 1 << 16;
+
+    void value() {
+        if (afterKey) {
+            afterKey = false;
+            return;
+        }
+        separator();
+    }
+    void separator() {
+        if (empty.empty()) return;
+        if (!empty.back()) buf += ',';
+        empty.back() = false;
+        newline(empty.size());
+    }
+    void close(char c) {
+        bool wasEmpty = empty.back();
+        empty.pop_back();
+        if (!wasEmpty) newline(empty.size());
+        buf += c;
+        maybeFlush();
+    }
+    void newline(size_t level) {
+        if (indent < 0) return;
+        buf += '\n';
+        buf.append((depth + level) * indent, ' ');
+    }
+    void maybeFlush() {
+        if (buf.size() >= FLUSH_SIZE) flush();
+    }
+    // 转义规则同nlohmann(ensure_ascii=false): 引号、反斜杠和控制字符
+    void writeString(std::string_view s) {
+        static const char hex[] = "0123456789abcdef";
+        buf += '"';
+        size_t from = 0;
+        for (size_t i = 0; i < s.size(); i++) {
+            unsigned char c = static_cast<unsigned char>(s[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') continue;
+            buf.append(s.data() + from, i - from);
+            from = i + 1;
+            switch (c) {
+                case '"': buf += "\\\""; break;
+                case '\\': buf += "\\\\"; break;
+                case '\b': buf += "\\b"; break;
+                case '\f': buf += "\\f"; break;
+                case '\n': buf += "\\n"; break;
+                case '\r': buf += "\\r"; break;
+                case '\t': buf += "\\t"; break;
+                default:
+                    buf += "\\u00";
+                    buf += hex[c >> 4];
+                    buf += hex[c & 15];
+            }
+        }
+        buf.append(s.data() + from, s.size() - from);
+        buf += '"';
+    }
+
+    std::ostream* out;
+    int indent;
+    size_t depth;
+    std::string buf;
+    std::vector<bool> empty;  // 每层容器是否还没有元素
+    bool afterKey = false;
+};
+
+// 去掉带缩进json中字符串以外的空白, 得到与dump()相同的紧凑文本
+inline std::string compactJSON(std::string_view pretty) {
+    std::string out;
+    out.reserve(pretty.size());
+    bool inString = false;
+    for (size_t i = 0; i < pretty.size(); i++) {
+        char c = pretty[i];
+        if (inString) {
+            out += c;
+            if (c == '\\') out += pretty[++i];
+            else if (c == '"') inString = false;
+        } else if (c != ' ' && c != '\n') {
+            out += c;
+            inString = c == '"';
+        }
+    }
+    return out;
+}
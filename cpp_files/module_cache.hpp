@@ -0,0 +1,287 @@
+#pragma once
+#include "mos_AST_Hierarchical.hpp"
+#include "mmap_file.hpp"
+#include <cstdio>
+
+// 模块解析结果的磁盘缓存(-i): 键为模块token流的哈希与其所实例化模块的键的组合,
+// 值为模块定义、展开后输出的json片段以及解析时的警告(行号相对模块起始行), 每个条目附带校验和
+const uint32_t MODULE_CACHE_VERSION = 2;
+
+inline uint64_t fnv1aBytes(const void* data, size_t len, uint64_t h = 1469598103934665603ull) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+inline uint64_t fnv1a(std::string_view s, uint64_t h = 1469598103934665603ull) {
+    return fnv1aBytes(s.data(), s.size(), h);
+}
+inline uint64_t hashCombine(uint64_t h, uint64_t v) {
+    unsigned char bytes[8];
+    for (int i = 0; i < 8; i++) bytes[i] = static_cast<unsigned char>(v >> (8 * i));
+    return fnv1aBytes(bytes, 8, h);
+}
+
+// 小端字节流写入
+class ByteWriter {
+public:
+    void u8(uint8_t v) { buf.push_back(static_cast<char>(v)); }
+    void u32(uint32_t v) {
+        for (int i = 0; i < 4; i++) buf.push_back(static_cast<char>(v >> (8 * i)));
+    }
+    void u64(uint64_t v) {
+        for (int i = 0; i < 8; i++) buf.push_back(static_cast<char>(v >> (8 * i)));
+    }
+    void str(std::string_view s) {
+        u64(s.size());
+        buf.append(s.data(), s.size());
+    }
+    std::string& data() { return buf; }
+    void clear() { buf.clear(); }
+private:
+    std::string buf;
+};
+
+// 小端字节流读取, 越界时抛出异常
+class ByteReader {
+public:
+    explicit ByteReader(std::string_view d) : data(d), pos(0) {}
+    uint8_t u8() {
+        need(1);
+        return static_cast<uint8_t>(data[pos++]);
+    }
+    uint32_t u32() {
+        need(4);
+        uint32_t v = 0;
+        for (int i = 0; i < 4; i++) v |= static_cast<uint32_t>(static_cast<unsigned char>(data[pos++])) << (8 * i);
+        return v;
+    }
+    uint64_t u64() {
+        need(8);
+        uint64_t v = 0;
+        for (int i = 0; i < 8; i++) v |= static_cast<uint64_t>(static_cast<unsigned char>(data[pos++])) << (8 * i);
+        return v;
+    }
+    std::string_view str() {
+        uint64_t len = u64();
+        need(len);
+        std::string_view s = data.substr(pos, len);
+        pos += len;
+        return s;
+    }
+    bool eof() const { return pos >= data.size(); }
+private:
+    void need(uint64_t n) {
+        if (n > data.size() - pos) throw std::runtime_error("Error:缓存文件已损坏");
+    }
+    std::string_view data;
+    size_t pos;
+};
+
+class ModuleCache {
+public:
+    struct Entry {
+        uint64_t key = 0;
+        std::string_view name;
+        std::string_view def;   // 序列化的模块定义
+        std::string_view json;  // 展开后的json片段(未输出过json时为空)
+        std::vector<std::pair<std::string_view, int>> warnings;
+    };
+
+    // 读取缓存文件: 版本不符或结构损坏时视为空缓存, 校验和不符的条目丢弃(按未命中重新解析)
+    bool load(const std::string& path) {
+        entries.clear();
+        index.clear();
+        if (!file.open(path)) return false;
+        try {
+            ByteReader in(file.view());
+            if (in.str() != MAGIC || in.u32() != MODULE_CACHE_VERSION) {
+                entries.clear();
+                return false;
+            }
+            uint32_t count = in.u32();
+            for (uint32_t i = 0; i < count; i++) {
+                Entry e;
+                e.key = in.u64();
+                e.name = in.str();
+                e.def = in.str();
+                e.json = in.str();
+                uint32_t nwarn = in.u32();
+                for (uint32_t w = 0; w < nwarn; w++) {
+                    std::string_view text = in.str();
+                    int line = static_cast<int>(in.u32());
+                    e.warnings.emplace_back(text, line);
+                }
+                if (in.u64() == checksum(e)) {
+                    entries.push_back(std::move(e));
+                }
+            }
+        } catch (const std::exception&) {
+            entries.clear();
+            return false;
+        }
+        for (size_t i = 0; i < entries.size(); i++) {
+            index.emplace(entries[i].key, i);
+        }
+        return true;
+    }
+    const Entry* find(uint64_t key) const {
+        auto it = index.find(key);
+        return it != index.end() ? &entries[it->second] : nullptr;
+    }
+    size_t size() const { return entries.size(); }
+    // 先写临时文件再替换; 条目可以引用旧缓存中的数据, 写完后旧缓存的映射失效
+    bool save(const std::string& path, const std::vector<Entry>& out) {
+        std::string tmp = path + ".tmp";
+        {
+            std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+            if (!f.is_open()) return false;
+            ByteWriter w;
+            w.str(MAGIC);
+            w.u32(MODULE_CACHE_VERSION);
+            w.u32(static_cast<uint32_t>(out.size()));
+            for (auto& e : out) {
+                w.u64(e.key);
+                w.str(e.name);
+                w.str(e.def);
+                w.str(e.json);
+                w.u32(static_cast<uint32_t>(e.warnings.size()));
+                for (auto& warn : e.warnings) {
+                    w.str(warn.first);
+                    w.u32(static_cast<uint32_t>(warn.second));
+                }
+                w.u64(checksum(e));
+                f.write(w.data().data(), w.data().size());
+                w.clear();
+            }
+            if (!f) return false;
+        }
+        entries.clear();
+        index.clear();
+        file.close();
+        std::remove(path.c_str());
+        return std::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+
+    // 模块定义: 本模块声明的端口、晶体管和实例(不含展开结果)
+    static std::string serialize(const ModuleNode& m) {
+        ByteWriter w;
+        w.str(symName(m.name));
+        w.u32(static_cast<uint32_t>(m.ports.size()));
+        for (auto& p : m.ports) {
+            w.str(symName(p->name));
+            w.u8(portTypeCode(p->type));
+        }
+        w.u32(static_cast<uint32_t>(m.mosfets.size()));
+        for (auto& mos : m.mosfets) {
+            w.u8(static_cast<uint8_t>(mos->type));
+            w.str(symName(mos->name));
+            w.str(symName(mos->drain));
+            w.str(symName(mos->source));
+            w.str(symName(mos->gate));
+        }
+        w.u32(static_cast<uint32_t>(m.subModules.size()));
+        for (auto& sub : m.subModules) {
+            w.str(symName(sub->name));
+            w.str(symName(sub->module_name));
+            w.u64(sub->portPos);
+            w.u64(sub->mosPos);
+            w.u32(static_cast<uint32_t>(sub->parameters.size()));
+            for (Symbol p : sub->parameters) {
+                w.str(symName(p));
+            }
+        }
+        return std::move(w.data());
+    }
+    // 恢复模块定义, 被实例化的模块须已在defs中恢复
+    static void deserialize(std::string_view blob, ModuleNode& m,
+                            const std::unordered_map<Symbol, ModuleNode*>& defs) {
+        ByteReader in(blob);
+        m.name = symbols().intern(in.str());
+        uint32_t nports = in.u32();
+        for (uint32_t i = 0; i < nports; i++) {
+            auto p = m.make<PortNode>();
+            p->name = symbols().intern(in.str());
+            p->type = portTypeName(in.u8());
+            m.addPort(p);
+        }
+        uint32_t nmos = in.u32();
+        for (uint32_t i = 0; i < nmos; i++) {
+            auto mos = m.make<MosNode>();
+            mos->type = in.u8();
+            mos->name = symbols().intern(in.str());
+            mos->drain = symbols().intern(in.str());
+            mos->source = symbols().intern(in.str());
+            mos->gate = symbols().intern(in.str());
+            m.mosfets.push_back(mos);
+            if (!m.connectMos(mos)) throw std::runtime_error("Error:缓存文件已损坏");
+        }
+        uint32_t nsub = in.u32();
+        for (uint32_t i = 0; i < nsub; i++) {
+            auto sub = m.make<SubModuleNode>();
+            sub->name = symbols().intern(in.str());
+            sub->module_name = symbols().intern(in.str());
+            auto it = defs.find(sub->module_name);
+            if (it == defs.end()) throw std::runtime_error("Error:缓存文件已损坏");
+            sub->module = it->second;
+            sub->portPos = in.u64();
+            sub->mosPos = in.u64();
+            uint32_t nparams = in.u32();
+            for (uint32_t k = 0; k < nparams; k++) {
+                sub->parameters.push_back(symbols().intern(in.str()));
+            }
+            size_t k = 0;
+            for (auto& cp : sub->module->ports) {
+                if (cp->type != INPUT && cp->type != OUTPUT) continue;
+                if (k >= sub->parameters.size()) throw std::runtime_error("Error:缓存文件已损坏");
+                auto p = m.findPort(sub->parameters[k++]);
+                if (p == nullptr) throw std::runtime_error("Error:缓存文件已损坏");
+                p->belongTo = sub;
+                if (cp->type == INPUT) {
+                    sub->inputPorts.push_back(p);
+                } else {
+                    sub->outputPorts.push_back(p);
+                }
+            }
+            m.subModules.push_back(sub);
+        }
+        m.collectPuts();
+    }
+
+private:
+    static constexpr std::string_view MAGIC = "SimpleEDA-module-cache";
+    static uint8_t portTypeCode(const std::string& type) {
+        if (type == INPUT) return 1;
+        if (type == OUTPUT) return 2;
+        if (type == WIRE) return 3;
+        if (type == POWER) return 4;
+        return 0;
+    }
+    static const char* portTypeName(uint8_t code) {
+        switch (code) {
+            case 1: return INPUT;
+            case 2: return OUTPUT;
+            case 3: return WIRE;
+            case 4: return POWER;
+        }
+        return UNDEF;
+    }
+    // 条目内容的校验和(各字段带长度, 避免相邻字段拼接后相同)
+    static uint64_t checksum(const Entry& e) {
+        uint64_t h = hashCombine(fnv1a(e.name), e.key);
+        h = fnv1a(e.def, hashCombine(h, e.def.size()));
+        h = fnv1a(e.json, hashCombine(h, e.json.size()));
+        h = hashCombine(h, e.warnings.size());
+        for (auto& w : e.warnings) {
+            h = fnv1a(w.first, hashCombine(h, w.first.size()));
+            h = hashCombine(h, static_cast<uint32_t>(w.second));
+        }
+        return h;
+    }
+
+    MappedFile file;
+    std::vector<Entry> entries;
+    std::unordered_map<uint64_t, size_t> index;
+};
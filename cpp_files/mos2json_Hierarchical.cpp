@@ -1,37 +1,120 @@
 #include "mos_AST_Hierarchical.hpp"
+#include "mos_Sim_Hierarchical.hpp"
+#include "mmap_file.hpp"
+#include "module_cache.hpp"
+#include "json_writer.hpp"
+#include "netbin.hpp"
+#include <string_view>
+#include <chrono>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <array>
 
-// 定义正则表达式
-const std::regex keywords_regex(R"(module|input|output|wire|pmos|nmos|endmodule)");
-const std::regex identifier_regex(R"([a-zA-Z_][a-zA-Z0-9_]*)");
-//暂时无用
-const std::regex number_regex(R"(\d+)");
-const std::regex operator_regex(R"([,\.\(\)])");
-const std::regex whitespace_regex(R"([ \t\n;]+)");
-
-using Token=std::pair<std::string,int>;
+// 字符分类表: 词法分析的每个字符只查一次表
+enum CharClass : unsigned char {
+    CC_OTHER = 0,
+    CC_ALPHA = 1,   // [a-zA-Z_], 标识符首字符
+    CC_DIGIT = 2,   // [0-9]
+    CC_SYMBOL = 4,  // , ( ) ;
+    CC_SPACE = 8    // 空白
+};
+constexpr std::array<unsigned char, 256> makeCharTable() {
+    std::array<unsigned char, 256> t{};
+    for (int c = 'a'; c <= 'z'; c++) t[c] = CC_ALPHA;
+    for (int c = 'A'; c <= 'Z'; c++) t[c] = CC_ALPHA;
+    t['_'] = CC_ALPHA;
+    for (int c = '0'; c <= '9'; c++) t[c] = CC_DIGIT;
+    t[','] = t['('] = t[')'] = t[';'] = CC_SYMBOL;
+    t[' '] = t['\n'] = t['\t'] = t['\r'] = t['\v'] = CC_SPACE;
+    return t;
+}
+constexpr std::array<unsigned char, 256> char_table = makeCharTable();
+inline unsigned char charClass(char c) { return char_table[static_cast<unsigned char>(c)]; }
 
-class Lexer {
-public:
-    Lexer(std::ifstream& f) : curLine(1),file(std::move(f)) {}
-    Token pairCurToken(){
-        Token token;int type;
+// 关键字: module|input|output|wire|pmos|nmos|endmodule, 按长度和首字符分派
+constexpr bool isKeyword(std::string_view s) {
+    switch (s.size()) {
+        case 4:
+            switch (s[0]) {
+                case 'w': return s == "wire";
+                case 'p': return s == "pmos";
+                case 'n': return s == "nmos";
+            }
+            return false;
+        case 5: return s == "input";
+        case 6:
+            switch (s[0]) {
+                case 'm': return s == "module";
+                case 'o': return s == "output";
+            }
+            return false;
+        case 9: return s == "endmodule";
+    }
+    return false;
+}
+static_assert(isKeyword("endmodule") && isKeyword("wire") && !isKeyword("wires"), "keyword table");
 
-        if (std::regex_match(current_token, keywords_regex)){
-            type = KEYWORD;
+// 标识符 [a-zA-Z_][a-zA-Z0-9_]* 与数字 \d+ 的判定
+inline int classifyToken(std::string_view s) {
+    if (s.empty()) return NONE;
+    unsigned char first = charClass(s[0]);
+    if (first == CC_ALPHA) {
+        if (isKeyword(s)) return KEYWORD;
+        for (size_t i = 1; i < s.size(); i++) {
+            if (!(charClass(s[i]) & (CC_ALPHA | CC_DIGIT))) return OTHER;
         }
-        else if (std::regex_match(current_token, identifier_regex)){
-            type = USER_DEF;
+        return USER_DEF;
+    }
+    if (first == CC_DIGIT) {
+        for (size_t i = 1; i < s.size(); i++) {
+            if (charClass(s[i]) != CC_DIGIT) return OTHER;
         }
+        return NUMBER;
+    }
+    return OTHER;
+}
 
-        token=std::make_pair(current_token,type);
-        current_token.clear();
-        
-        return token;
+// Token文本为视图: 映射模式下指向文件映射, 流模式下指向lexer内部的字符串池
+using Token=std::pair<std::string_view,int>;
+
+class Lexer {
+public:
+    // 流模式(如stdin): 逐字符读取
+    Lexer(std::istream& in) : curLine(1),file(&in) {}
+    // 映射模式: 直接在内存缓冲(如MappedFile)上切分token, 不做拷贝
+    Lexer(std::string_view buf, int line = 1) : curLine(line),file(nullptr),buffer(buf),pos(0) {}
+    Token pairCurToken(std::string_view cur){
+        return std::make_pair(cur,classifyToken(cur));
     }
     std::string getLine(){
         return std::to_string(curLine);
     }
+    int lineNumber() const {
+        return curLine;
+    }
+    bool buffered() const {
+        return file==nullptr;
+    }
+    std::string_view bufferView() const {
+        return buffer;
+    }
+    // 与lexer相同的行计数规则: \n 或单独的 \r 记为一行
+    static int countLines(std::string_view text){
+        int lines=0;
+        for(size_t i=0;i<text.size();i++){
+            if(text[i]=='\n'||(text[i]=='\r'&&(i+1>=text.size()||text[i+1]!='\n'))){
+                lines++;
+            }
+        }
+        return lines;
+    }
     Token getNextToken(){
+        if(file==nullptr){
+            return getNextBufferToken();
+        }
         if(nextToken.first!=""){
             auto token=nextToken;
             nextToken.first="";
@@ -39,22 +122,23 @@ public:
         }
         // 逐个字符匹配,按顺序添加到词列表
         char c;
-        while (file.get(c)) {
-            if (c == ',' || c == '(' || c == ')'||c==';') {
+        while (file->get(c)) {
+            unsigned char cc=charClass(c);
+            if (cc==CC_SYMBOL) {
                 if (!current_token.empty()) {
-                    nextToken=std::make_pair(std::string(1, c),SYMBOL);
-                    return pairCurToken();
+                    nextToken=std::make_pair(symbolView(c),SYMBOL);
+                    return pairCurToken(internCurToken());
                 }
                 else{
-                    return std::make_pair(std::string(1, c),SYMBOL);
+                    return std::make_pair(symbolView(c),SYMBOL);
                 }
             } 
-            else if (c==' '||c=='\n'||c=='\t'||c=='\r'||c=='\v') {
-                if(c=='\n'||c=='\r'){
+            else if (cc==CC_SPACE) {
+                if(c=='\n'||(c=='\r'&&file->peek()!='\n')){
                     curLine++;
                 }
                 if (!current_token.empty()) {
-                    return pairCurToken();
+                    return pairCurToken(internCurToken());
                 }
             } 
             else {
@@ -62,16 +146,65 @@ public:
             }
         }
         if (!current_token.empty()) {
-            return pairCurToken();
+            return pairCurToken(internCurToken());
         }
         else return std::make_pair("",NONE);
     }
 
 private:
+    Token getNextBufferToken(){
+        const char* data=buffer.data();
+        size_t n=buffer.size();
+        // 跳过空白
+        while(pos<n){
+            char c=data[pos];
+            if(charClass(c)==CC_SPACE){
+                if(c=='\n'||(c=='\r'&&(pos+1>=n||data[pos+1]!='\n'))){
+                    curLine++;
+                }
+                pos++;
+            }
+            else break;
+        }
+        if(pos>=n){
+            return std::make_pair(std::string_view(),NONE);
+        }
+        char c=data[pos];
+        if (charClass(c)==CC_SYMBOL) {
+            return std::make_pair(buffer.substr(pos++,1),SYMBOL);
+        }
+        size_t begin=pos;
+        while(pos<n&&!(charClass(data[pos])&(CC_SYMBOL|CC_SPACE))){
+            pos++;
+        }
+        Token token=pairCurToken(buffer.substr(begin,pos-begin));
+        // 与流模式一致: 结束token的空白字符随token一起读掉(行号同步)
+        if(pos<n&&charClass(c=data[pos])==CC_SPACE){
+            if(c=='\n'||(c=='\r'&&(pos+1>=n||data[pos+1]!='\n'))){
+                curLine++;
+            }
+            pos++;
+        }
+        return token;
+    }
+    static std::string_view symbolView(char c){
+        static const char symbols[]=",();";
+        const char* p=std::char_traits<char>::find(symbols,4,c);
+        return std::string_view(p,1);
+    }
+    // 流模式下token需要稳定的存储, 直接放入全局符号表
+    std::string_view internCurToken(){
+        std::string_view v=symName(symbols().intern(current_token));
+        current_token.clear();
+        return v;
+    }
+
     std::string current_token;
     Token nextToken;//under analysis
-    std::ifstream file;
     int curLine;
+    std::istream* file;
+    std::string_view buffer;
+    size_t pos;
     // std::vector<Token> tokens;
     // size_t pos;
 };
@@ -80,9 +213,9 @@ json MosNode::toJSON() const{
     json j;
     j["type"] = (type == PMOS) ? "pmos" : "nmos";
     //j["name"] = name;
-    j["drain"] = drain;
-    j["source"] = source;
-    j["gate"] = gate;
+    j["drain"] = symName(drain);
+    j["source"] = symName(source);
+    j["gate"] = symName(gate);
     return j;
 }
 json PortNode::toJSON() const{
@@ -90,10 +223,10 @@ json PortNode::toJSON() const{
     j["type"] = type;
     //j["name"] = name;
     for(auto&i:in){
-        j["in"].push_back(i->name);
+        j["in"].push_back(symName(i->name));
     }
     for(auto&o:out){
-        j["out"].push_back(o->name);
+        j["out"].push_back(symName(o->name));
     }
     return j;
 }
@@ -101,8 +234,12 @@ json PortNode::toJSON() const{
 // 实现SubModuleNode的toJSON方法
 json SubModuleNode::toJSON() const {
     json j;
-    j["module"] = module_name;
-    j["parameters"] = parameters;
+    j["module"] = symName(module_name);
+    json params = json::array();
+    for (auto p : parameters) {
+        params.push_back(symName(p));
+    }
+    j["parameters"] = params;
     return j;
 }
 
@@ -113,21 +250,21 @@ json ModuleNode::toJSON() const{
     json sub_j; // 添加子模块JSON对象
     
     j["type"]="module";
-    j["name"]=name;
+    j["name"]=symName(name);
     
     // 添加端口信息
     for(const auto&port:ports){
-        port_j[port->name]=port->toJSON();
+        port_j[symName(port->name)]=port->toJSON();
     }
     
     // 添加晶体管信息
     for (const auto& mosfet : mosfets) {
-        mos_j[mosfet->name]=mosfet->toJSON();
+        mos_j[symName(mosfet->name)]=mosfet->toJSON();
     }
     
     // 添加子模块信息
     for (const auto& submodule : subModules) {
-        sub_j[submodule->name] = submodule->toJSON();
+        sub_j[symName(submodule->name)] = submodule->toJSON();
     }
     
     j["ports"]=port_j;
@@ -137,61 +274,712 @@ json ModuleNode::toJSON() const{
     return j;
 }
 
+void MosNode::writeJSON(JsonWriter& w) const{
+    w.beginObject();
+    w.key("type");
+    w.string((type == PMOS) ? "pmos" : "nmos");
+    w.key("drain");
+    w.string(symName(drain));
+    w.key("source");
+    w.string(symName(source));
+    w.key("gate");
+    w.string(symName(gate));
+    w.endObject();
+}
+void PortNode::writeJSON(JsonWriter& w) const{
+    w.beginObject();
+    w.key("type");
+    w.string(type);
+    if(!in.empty()){
+        w.key("in");
+        w.beginArray();
+        for(auto&i:in){
+            w.string(symName(i->name));
+        }
+        w.endArray();
+    }
+    if(!out.empty()){
+        w.key("out");
+        w.beginArray();
+        for(auto&o:out){
+            w.string(symName(o->name));
+        }
+        w.endArray();
+    }
+    w.endObject();
+}
+void SubModuleNode::writeJSON(JsonWriter& w) const{
+    w.beginObject();
+    w.key("module");
+    w.string(symName(module_name));
+    w.key("parameters");
+    w.beginArray();
+    for (auto p : parameters) {
+        w.string(symName(p));
+    }
+    w.endArray();
+    w.endObject();
+}
+// 与toJSON一致: 没有端口/晶体管/子模块时对应项为null
+void ModuleNode::writeJSON(JsonWriter& w) const{
+    w.beginObject();
+    w.key("type");
+    w.string("module");
+    w.key("name");
+    w.string(symName(name));
+    w.key("ports");
+    if(ports.empty()){
+        w.null();
+    }
+    else{
+        w.beginObject();
+        for(const auto&port:ports){
+            w.key(symName(port->name));
+            port->writeJSON(w);
+        }
+        w.endObject();
+    }
+    w.key("mosfets");
+    if(mosfets.empty()){
+        w.null();
+    }
+    else{
+        w.beginObject();
+        for (const auto& mosfet : mosfets) {
+            w.key(symName(mosfet->name));
+            mosfet->writeJSON(w);
+        }
+        w.endObject();
+    }
+    w.key("subModules");
+    if(subModules.empty()){
+        w.null();
+    }
+    else{
+        w.beginObject();
+        for (const auto& submodule : subModules) {
+            w.key(symName(submodule->name));
+            submodule->writeJSON(w);
+        }
+        w.endObject();
+    }
+    w.endObject();
+}
+
+// 惰性展开: 把实例的晶体管和内部端口以 "实例名.名称" 复制进来, 端口与晶体管保持源文件中的先后顺序
+ModuleNode* ModuleNode::flatten(){
+    if(subModules.empty()){
+        return this;
+    }
+    if(flat){
+        return flat;
+    }
+    auto f=arena.make<ModuleNode>();
+    f->name=name;
+    auto addMos=[&](MosNode* mos){
+        f->mosfets.push_back(mos);
+        if(!f->connectMos(mos)){
+            throw std::runtime_error("Error:展开模块"+symName(name)+"时存在未定义的端口名");
+        }
+    };
+    size_t pi=0,mi=0;
+    auto copyUntil=[&](size_t portEnd,size_t mosEnd){
+        for(;pi<portEnd;pi++){
+            auto p=f->make<PortNode>();
+            p->name=ports[pi]->name;
+            p->type=ports[pi]->type;
+            f->addPort(p);
+        }
+        for(;mi<mosEnd;mi++){
+            auto mos=f->make<MosNode>();
+            mos->type=mosfets[mi]->type;
+            mos->name=mosfets[mi]->name;
+            mos->drain=mosfets[mi]->drain;
+            mos->source=mosfets[mi]->source;
+            mos->gate=mosfets[mi]->gate;
+            addMos(mos);
+        }
+    };
+    for(auto&inst:subModules){
+        copyUntil(inst->portPos,inst->mosPos);
+        auto child=inst->module->flatten();
+        auto sub=f->make<SubModuleNode>();
+        sub->name=inst->name;
+        sub->module_name=inst->module_name;
+        sub->parameters=inst->parameters;
+        sub->module=inst->module;
+        f->subModules.push_back(sub);
+        // 子模块端口在本模块中的名称: 输入输出端口为参数, power不变, 其余加实例名前缀
+        std::unordered_map<Symbol,Symbol> rename;
+        std::vector<bool> isInput;
+        for(auto&p:child->ports){
+            if(p->type==INPUT || p->type==OUTPUT){
+                rename[p->name]=inst->parameters[isInput.size()];
+                isInput.push_back(p->type==INPUT);
+            }
+            else if(p->type==POWER){
+                rename[p->name]=p->name;
+            }
+            else{
+                //加入内部端口
+                auto subPortNode=f->make<PortNode>();
+                subPortNode->name=symbols().intern(inst->name,p->name);
+                subPortNode->type=WIRE;
+                f->addPort(subPortNode);
+                sub->wirePorts.push_back(subPortNode);
+                rename[p->name]=subPortNode->name;
+            }
+        }
+        //加入晶体管
+        for(auto&mos:child->mosfets){
+            auto subMosNode=f->make<MosNode>();
+            subMosNode->type=mos->type;
+            subMosNode->name=symbols().intern(inst->name,mos->name);
+            subMosNode->drain=rename.at(mos->drain);
+            subMosNode->source=rename.at(mos->source);
+            subMosNode->gate=rename.at(mos->gate);
+            addMos(subMosNode);
+            sub->mosfets.push_back(subMosNode);
+        }
+        // 加入输入输出端口映射关系
+        for(size_t i=0;i<sub->parameters.size();i++){
+            auto p=f->findPort(sub->parameters[i]);
+            p->belongTo=sub;
+            if(isInput[i]){
+                sub->inputPorts.push_back(p);
+            }
+            else{
+                sub->outputPorts.push_back(p);
+            }
+        }
+    }
+    copyUntil(ports.size(),mosfets.size());
+    f->collectPuts();
+    flat=f;
+    return flat;
+}
+
+// 预扫描得到的一个 module ... endmodule 范围
+struct ModuleSpan {
+    Symbol name;
+    size_t begin;   // "module" 所在的字节偏移
+    size_t end;     // 到下一个module之前(或文件末尾)
+    int line;       // begin处的行号
+    std::vector<Symbol> deps; // 其中实例化的模块名
+    uint64_t hash=0;    // module到endmodule的token流哈希
+    uint64_t layout=0;  // 各token相对begin的行号哈希(影响警告中的行号)
+};
+
+// 只做词法分析, 按Parser::parseModule相同的语句分派找出模块范围和实例化依赖, 不建立AST
+// hashTokens时同时计算每个模块的token流哈希(用于-i缓存)
+std::vector<ModuleSpan> prescanModules(std::string_view text,bool hashTokens=false){
+    std::vector<ModuleSpan> spans;
+    Lexer lexer(text);
+    Token token;
+    size_t lineFrom=0;
+    int line=1;
+    ModuleSpan* cur=nullptr;
+    auto lex=[&](){
+        token=lexer.getNextToken();
+        if(cur!=nullptr){
+            cur->hash=fnv1a(" ",fnv1a(token.first,cur->hash));
+            cur->layout=hashCombine(cur->layout,lexer.lineNumber()-cur->line);
+        }
+        return token;
+    };
+    auto next=[&](){
+        lex();
+        return token.second!=NONE && token.first!="endmodule";
+    };
+    auto skipUntil=[&](std::string_view stop){
+        while(next() && token.first!=stop);
+    };
+    while((token=lexer.getNextToken()).second!=NONE){
+        if(token.first!="module"){
+            continue;
+        }
+        ModuleSpan span;
+        span.begin=token.first.data()-text.data();
+        line+=Lexer::countLines(text.substr(lineFrom,span.begin-lineFrom));
+        lineFrom=span.begin;
+        span.line=line;
+        if(hashTokens){
+            span.hash=fnv1a("module ");
+            span.layout=hashCombine(fnv1a(""),lexer.lineNumber()-line);
+            cur=&span;
+        }
+        span.name=symbols().intern(lex().first);
+        skipUntil(")");
+        while(token.second!=NONE && token.first!="endmodule" && next()){
+            if(token.first=="input"||token.first=="output"||token.first=="wire"||token.first=="pmos"||token.first=="nmos"){
+                skipUntil(";");
+            }
+            else if(token.first=="//"){
+                while(next() && token.first!=";" && token.first!=")");
+            }
+            else if(token.second==USER_DEF){
+                span.deps.push_back(symbols().intern(token.first));
+                skipUntil(";");
+            }
+        }
+        cur=nullptr;
+        spans.push_back(std::move(span));
+    }
+    // 每个范围延伸到下一个module之前, 保证模块结尾的行号与整体解析一致
+    for(size_t i=0;i<spans.size();i++){
+        spans[i].end=i+1<spans.size()?spans[i+1].begin:text.size();
+    }
+    return spans;
+}
+
 class Parser{
 private:
     Lexer& lexer;
     Token token;//under analysis
     int pcount,ncount;
-    std::shared_ptr<ModuleNode> moduleNode;
-    std::vector<std::shared_ptr<ModuleNode>> modules;
+    ModuleNode* moduleNode;
+    // 模块节点的存储, 各模块的端口/晶体管/实例在模块自己的arena中
+    Arena arena;
+    std::vector<ModuleNode*> modules;
+    std::unordered_map<Symbol, ModuleNode*> moduleIndex;
+    std::unordered_set<Symbol> instanceNames;
+    // 实例化时查找的模块定义; 并行解析时指向共享的索引, 且只允许使用预扫描得到的依赖
+    const std::unordered_map<Symbol, ModuleNode*>* definitions;
+    const std::vector<Symbol>* allowedDeps=nullptr;
+    std::ostream* log;
+    unsigned threads;
+    // token视图到符号的本地缓存, 减少并行解析时对全局符号表的加锁
+    std::unordered_map<std::string_view,Symbol> localSymbols;
+    Symbol intern(std::string_view name){
+        auto it=localSymbols.find(name);
+        if(it!=localSymbols.end()) return it->second;
+        Symbol id=symbols().intern(name);
+        localSymbols.emplace(name,id);
+        return id;
+    }
+    // 解析警告(文本与行号), 缓存时按模块起始行换算为相对行号
+    std::vector<std::pair<std::string,int>> warnings;
+    void warn(const std::string& msg){
+        warnings.emplace_back(msg,lexer.lineNumber());
+        *log<<msg<<",Line "<<lexer.lineNumber()<<std::endl;
+    }
+    // -i缓存: 每个模块的键、命中的缓存条目、尚未恢复定义的模块以及本次生成的json片段
+    ModuleCache* cache=nullptr;
+    std::string cachePath;
+    std::vector<ModuleSpan> spans;
+    std::vector<std::vector<size_t>> moduleDeps;
+    std::vector<uint64_t> keys;
+    std::vector<const ModuleCache::Entry*> hits;
+    std::vector<char> unrestored;
+    std::vector<std::vector<std::pair<std::string,int>>> moduleWarnings;
+    std::vector<std::string> jsonText;
 public:
-    Parser(Lexer& lexer):lexer(lexer),pcount(1),ncount(1){
+    Parser(Lexer& lexer):lexer(lexer),pcount(1),ncount(1),definitions(&moduleIndex),log(&std::cout){
+        threads=std::max(1u,std::thread::hardware_concurrency());
         resetModule();
-        moduleNode = std::make_shared<ModuleNode>();
+        moduleNode = arena.make<ModuleNode>();
+    }
+    void setThreads(unsigned n){
+        threads=std::max(1u,n);
+    }
+    // 解析警告的输出位置, 默认为std::cout
+    void setLog(std::ostream& out){
+        log=&out;
+    }
+    // 使用磁盘缓存(仅缓冲模式): 未改动的模块及其依赖直接取缓存, 不再解析
+    void useCache(ModuleCache& c,const std::string& path){
+        cache=&c;
+        cachePath=path;
+        cache->load(path);
     }
+    // 缓冲模式下按依赖关系并行解析(允许实例化后定义的模块); 流模式下顺序解析
     void parse(){
+        if(lexer.buffered()){
+            parseParallel(lexer.bufferView());
+        }
+        else{
+            parseSerial();
+        }
+    }
+    void parseSerial(){
         while((token=lexer.getNextToken()).second!=NONE){
             if(token.first=="module"){
                 parseModule();
             }
             if(token.first=="endmodule"){
                 modules.push_back(moduleNode);
+                moduleIndex.emplace(moduleNode->name, moduleNode);
                 resetModule();
                 //分析新定义moduleNode
-                moduleNode = std::make_shared<ModuleNode>();
+                moduleNode = arena.make<ModuleNode>();
             }
         }
     }
-    json toJSON() const {
+    json toJSON() {
+        restoreAll();
         json module_j;
         for(const auto&m:modules){
-            module_j[m->name]=m->toJSON();
+            module_j[symName(m->name)]=m->flatten()->toJSON();
         }
         return module_j;
     }
-    std::vector<std::shared_ptr<ModuleNode>> getModules() const {
+    // 与toJSON().dump(indent)相同的输出, 边展开边写出, 不建立json对象
+    // 使用缓存时按模块拼接json片段(命中缓存的模块直接使用缓存的片段)
+    void writeJSON(std::ostream& out,int indent=4){
+        JsonWriter w(&out,indent);
+        if(modules.empty()){
+            w.null();
+            return;
+        }
+        w.beginObject();
+        for(size_t j:outputModules()){
+            w.key(symName(modules[j]->name));
+            if(keys.empty()){
+                modules[j]->flatten()->writeJSON(w);
+            }
+            else if(indent==4){
+                w.raw(moduleJSON(j));
+            }
+            else{
+                w.raw(compactJSON(moduleJSON(j)));
+            }
+        }
+        w.endObject();
+    }
+    // 与writeJSON相同的模块(展开后)写成二进制网表
+    bool writeNetlist(std::ostream& out){
+        restoreAll();
+        netbin::Builder b;
+        for(size_t j:outputModules()){
+            auto m=modules[j]->flatten();
+            netbin::ModuleRec rec;
+            rec.name=b.str(symName(m->name));
+            rec.firstPort=b.ports.size();
+            rec.portCount=m->ports.size();
+            rec.firstMos=b.mosfets.size();
+            rec.mosCount=m->mosfets.size();
+            rec.firstInst=b.instances.size();
+            rec.instCount=m->subModules.size();
+            std::unordered_map<const MosNode*,uint32_t> mosIndex;
+            for(auto&mos:m->mosfets){
+                mosIndex.emplace(mos,b.mosfets.size());
+                b.mosfets.push_back({b.str(symName(mos->name)),mos->type==PMOS?netbin::MOS_PMOS:netbin::MOS_NMOS,
+                                     b.str(symName(mos->drain)),b.str(symName(mos->source)),b.str(symName(mos->gate))});
+            }
+            for(auto&port:m->ports){
+                netbin::PortRec pr;
+                pr.name=b.str(symName(port->name));
+                pr.type=netbin::portTypeCode(port->type);
+                pr.firstIn=b.fanout.size();
+                pr.inCount=port->in.size();
+                for(auto&mos:port->in){
+                    b.fanout.push_back(mosIndex.at(mos));
+                }
+                pr.firstOut=b.fanout.size();
+                pr.outCount=port->out.size();
+                for(auto&mos:port->out){
+                    b.fanout.push_back(mosIndex.at(mos));
+                }
+                b.ports.push_back(pr);
+            }
+            for(auto&sub:m->subModules){
+                b.instances.push_back({b.str(symName(sub->name)),b.str(symName(sub->module_name)),
+                                       static_cast<uint32_t>(b.params.size()),static_cast<uint32_t>(sub->parameters.size())});
+                for(Symbol p:sub->parameters){
+                    b.params.push_back(b.str(symName(p)));
+                }
+            }
+            b.modules.push_back(rec);
+        }
+        return b.write(out);
+    }
+    // 写回缓存: 只保留本次输入中的模块, 全部命中且没有新的json片段时不写
+    // 写回后旧缓存失效, 须在使用完解析结果后调用
+    bool saveCache(){
+        if(cache==nullptr || keys.empty()) return false;
+        bool changed=cache->size()!=modules.size();
+        std::vector<std::string> defs(modules.size());
+        std::vector<ModuleCache::Entry> out(modules.size());
+        for(size_t i=0;i<modules.size();i++){
+            auto& e=out[i];
+            if(hits[i]){
+                e=*hits[i];
+            }
+            else{
+                changed=true;
+                e.key=keys[i];
+                e.name=symName(modules[i]->name);
+                defs[i]=ModuleCache::serialize(*modules[i]);
+                e.def=defs[i];
+                for(auto& w:moduleWarnings[i]){
+                    e.warnings.emplace_back(w.first,w.second);
+                }
+            }
+            if(!jsonText[i].empty()){
+                changed=changed||e.json.empty();
+                e.json=jsonText[i];
+            }
+        }
+        return changed && cache->save(cachePath,out);
+    }
+    std::vector<ModuleNode*> getModules() {
+        restoreAll();
         return modules;
     }
 private:
+    // 解析单个模块范围(并行解析中的一个任务)
+    Parser(Lexer& lexer,const std::unordered_map<Symbol, ModuleNode*>& defs,
+           const std::vector<Symbol>& deps,std::ostream& out)
+        :lexer(lexer),pcount(1),ncount(1),definitions(&defs),allowedDeps(&deps),log(&out),threads(1){}
+    void parseSpan(ModuleNode* node){
+        moduleNode=node;
+        while((token=lexer.getNextToken()).second!=NONE && token.first!="module");
+        parseModule();
+    }
+    // 输出的模块: 与ordered_json一致, 重名模块保留第一次出现的位置, 内容为最后一次定义
+    std::vector<size_t> outputModules() const {
+        std::unordered_map<Symbol,size_t> last;
+        for(size_t i=0;i<modules.size();i++){
+            last[modules[i]->name]=i;
+        }
+        std::vector<size_t> order;
+        std::unordered_set<Symbol> seen;
+        for(size_t i=0;i<modules.size();i++){
+            if(seen.insert(modules[i]->name).second){
+                order.push_back(last[modules[i]->name]);
+            }
+        }
+        return order;
+    }
+    // 从缓存恢复模块定义, 先恢复其实例化的模块; 缓存条目无法恢复时按未命中重新解析
+    void restore(size_t i){
+        if(!unrestored[i]) return;
+        for(size_t d:moduleDeps[i]){
+            restore(d);
+        }
+        unrestored[i]=0;
+        try{
+            ModuleCache::deserialize(hits[i]->def,*modules[i],moduleIndex);
+        }
+        catch(const std::exception&){
+            hits[i]=nullptr;
+            reparse(i);
+        }
+    }
+    // 用新的模块节点重新解析模块范围(恢复失败的节点可能只填充了一部分)
+    // 缓存的警告已经输出过, 重新解析的警告只留作写回缓存
+    void reparse(size_t i){
+        ModuleNode* node=arena.make<ModuleNode>();
+        auto it=moduleIndex.find(spans[i].name);
+        if(it!=moduleIndex.end() && it->second==modules[i]){
+            it->second=node;
+        }
+        modules[i]=node;
+        std::string_view text=lexer.bufferView();
+        Lexer spanLexer(text.substr(spans[i].begin,spans[i].end-spans[i].begin),spans[i].line);
+        std::ostringstream discard;
+        Parser sub(spanLexer,moduleIndex,spans[i].deps,discard);
+        sub.parseSpan(node);
+        moduleWarnings[i].clear();
+        for(auto& w:sub.warnings){
+            moduleWarnings[i].emplace_back(w.first,w.second-spans[i].line);
+        }
+    }
+    void restoreAll(){
+        for(size_t i=0;i<unrestored.size();i++){
+            restore(i);
+        }
+    }
+    // 单个模块展开后的json(缩进到第二层)
+    std::string_view moduleJSON(size_t i){
+        if(jsonText.size()<=i){
+            jsonText.resize(modules.size());
+        }
+        if(jsonText[i].empty()){
+            if(i<hits.size() && hits[i] && !hits[i]->json.empty()){
+                return hits[i]->json;
+            }
+            if(i<unrestored.size()){
+                restore(i);
+            }
+            JsonWriter w(nullptr,4,1);
+            modules[i]->flatten()->writeJSON(w);
+            jsonText[i]=std::move(w.buffer());
+        }
+        return jsonText[i];
+    }
+    void parseParallel(std::string_view text){
+        spans=prescanModules(text,cache!=nullptr);
+        size_t n=spans.size();
+        modules.clear();
+        moduleIndex.clear();
+        std::unordered_map<Symbol,size_t> first;
+        for(size_t i=0;i<n;i++){
+            modules.push_back(arena.make<ModuleNode>());
+            if(first.emplace(spans[i].name,i).second){
+                moduleIndex.emplace(spans[i].name,modules[i]);
+            }
+        }
+        // 依赖图: 子模块先于实例化它的模块解析
+        std::vector<std::vector<size_t>> dependents(n);
+        std::vector<size_t> pending(n,0);
+        moduleDeps.assign(n,{});
+        for(size_t i=0;i<n;i++){
+            for(Symbol dep:spans[i].deps){
+                auto it=first.find(dep);
+                if(it!=first.end() && std::find(moduleDeps[i].begin(),moduleDeps[i].end(),it->second)==moduleDeps[i].end()){
+                    moduleDeps[i].push_back(it->second);
+                    dependents[it->second].push_back(i);
+                    pending[i]++;
+                }
+            }
+        }
+        std::vector<size_t> order;
+        {
+            std::vector<size_t> count=pending;
+            for(size_t i=0;i<n;i++){
+                if(count[i]==0) order.push_back(i);
+            }
+            for(size_t k=0;k<order.size();k++){
+                for(size_t d:dependents[order[k]]){
+                    if(--count[d]==0) order.push_back(d);
+                }
+            }
+            for(size_t i=0;i<n;i++){
+                if(count[i]!=0){
+                    throw std::runtime_error("Error:模块"+symName(spans[i].name)+"存在循环实例化,Line "+std::to_string(spans[i].line));
+                }
+            }
+        }
+
+        std::vector<std::ostringstream> logs(n);
+        std::vector<std::exception_ptr> errors(n);
+        std::vector<char> skipped(n,0);
+        hits.assign(n,nullptr);
+        unrestored.assign(n,0);
+        moduleWarnings.assign(n,{});
+        jsonText.assign(n,{});
+        size_t done=0;
+        if(cache!=nullptr){
+            // 键: token流哈希与所实例化模块的内容哈希组合, 再加上行号布局
+            keys.assign(n,0);
+            std::vector<uint64_t> content(n);
+            for(size_t i:order){
+                uint64_t h=hashCombine(spans[i].hash,MODULE_CACHE_VERSION);
+                for(Symbol dep:spans[i].deps){
+                    auto it=first.find(dep);
+                    h=it!=first.end()?hashCombine(h,content[it->second]):fnv1a(symName(dep),h);
+                }
+                content[i]=h;
+                keys[i]=hashCombine(h,spans[i].layout);
+                hits[i]=cache->find(keys[i]);
+                // 所实例化的模块未命中(其缓存条目已被丢弃)时一并重新解析, 命中的模块只依赖命中的模块
+                for(size_t d:moduleDeps[i]){
+                    if(!hits[d]) hits[i]=nullptr;
+                }
+            }
+            // 命中的模块不再解析; 只有被重新解析的模块所实例化的才需要立即恢复定义
+            std::vector<char> needed(n,0);
+            for(size_t k=order.size();k-->0;){
+                size_t i=order[k];
+                if(!hits[i] || needed[i]){
+                    for(size_t d:moduleDeps[i]) needed[d]=1;
+                }
+            }
+            for(size_t i:order){
+                if(!hits[i]) continue;
+                modules[i]->name=spans[i].name;
+                unrestored[i]=1;
+                if(needed[i]) restore(i);
+                for(auto& w:hits[i]->warnings){
+                    logs[i]<<w.first<<",Line "<<spans[i].line+w.second<<std::endl;
+                }
+                done++;
+                for(size_t d:dependents[i]){
+                    pending[d]--;
+                }
+            }
+        }
+        std::deque<size_t> ready;
+        for(size_t i=0;i<n;i++){
+            if(!hits[i] && pending[i]==0) ready.push_back(i);
+        }
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        auto worker=[&](){
+            std::unique_lock<std::mutex> lock(mutex);
+            while(true){
+                cv.wait(lock,[&](){ return !ready.empty() || done==n; });
+                if(ready.empty()) return;
+                size_t i=ready.front();
+                ready.pop_front();
+                bool skip=skipped[i];
+                lock.unlock();
+                if(!skip){
+                    try{
+                        Lexer spanLexer(text.substr(spans[i].begin,spans[i].end-spans[i].begin),spans[i].line);
+                        Parser sub(spanLexer,moduleIndex,spans[i].deps,logs[i]);
+                        sub.parseSpan(modules[i]);
+                        for(auto& w:sub.warnings){
+                            moduleWarnings[i].emplace_back(w.first,w.second-spans[i].line);
+                        }
+                    }
+                    catch(...){
+                        errors[i]=std::current_exception();
+                    }
+                }
+                lock.lock();
+                done++;
+                // 依赖解析失败的模块不再解析
+                bool failed=skip||errors[i];
+                for(size_t d:dependents[i]){
+                    if(failed) skipped[d]=1;
+                    if(--pending[d]==0) ready.push_back(d);
+                }
+                cv.notify_all();
+            }
+        };
+        size_t workers=std::min<size_t>(threads,n-done);
+        if(workers<=1){
+            worker();
+        }
+        else{
+            std::vector<std::thread> pool;
+            for(size_t t=0;t<workers;t++){
+                pool.emplace_back(worker);
+            }
+            for(auto&t:pool){
+                t.join();
+            }
+        }
+        // 按源文件顺序输出警告, 并报告第一个出错的模块
+        for(size_t i=0;i<n;i++){
+            *log<<logs[i].str();
+            if(errors[i]){
+                std::rethrow_exception(errors[i]);
+            }
+        }
+    }
     void parseModule(){
-        moduleNode->name = lexer.getNextToken().first;
+        moduleNode->name = intern(lexer.getNextToken().first);
         //TODO:删除无用port
-        auto vcc=std::make_shared<PortNode>();
-        auto gnd=std::make_shared<PortNode>();
-        vcc->name = "VCC";
-        gnd->name = "GND";
+        auto vcc=moduleNode->make<PortNode>();
+        auto gnd=moduleNode->make<PortNode>();
+        vcc->name = SYM_VCC;
+        gnd->name = SYM_GND;
         vcc->type = POWER;
         gnd->type = POWER;
-        moduleNode->ports.push_back(vcc);
-        moduleNode->ports.push_back(gnd);
+        moduleNode->addPort(vcc);
+        moduleNode->addPort(gnd);
 
         expect("(");
         while((token=lexer.getNextToken()).first!=")")
         {
             if(token.second==USER_DEF){
-                auto portNode=std::make_shared<PortNode>();
-                portNode->name = token.first;
-                moduleNode->ports.push_back(portNode);
+                auto portNode=moduleNode->make<PortNode>();
+                portNode->name = intern(token.first);
+                moduleNode->addPort(portNode);
             }
             else if(token.first==","){
                 continue;
@@ -220,54 +1008,49 @@ private:
         removeEmptyPort();
         AddPuts();
     }
-    void parsePort(const std::string type){
+    void parsePort(std::string_view type){
         //需要分号h
         while((token=lexer.getNextToken()).first!=";"){
             if(token.second == USER_DEF){
+                Symbol sym = intern(token.first);
+                auto port = moduleNode->findPort(sym);
                 if(type== "wire"){
-                    bool repeat_def_wire=false;
-                    for (auto& port : moduleNode->ports) {
-                        if (port->name == token.first && port->type==WIRE) {
-                            std::cout<<"Warning:"<<"定义的wire类型中存在重复名称,Line "+lexer.getLine()<<std::endl;
-                            repeat_def_wire=true;
-                        }
-                        else if (port->name == token.first && port->type==POWER) {
-                            throw std::runtime_error("Error:VCC,GND是保留关键字,Line "+lexer.getLine());
-                        }
-                        else if (port->name == token.first && (port->type==INPUT || port->type==OUTPUT)){
-                            throw std::runtime_error("Error不允许把输入/输出端口重定义为wire,Line "+lexer.getLine());
-                        }
-                    }
-                    // 跳过重复定义
-                    if(!repeat_def_wire){
-                        auto wireNode=std::make_shared<PortNode>();
-                        wireNode->name = token.first;
+                    if (port == nullptr) {
+                        auto wireNode=moduleNode->make<PortNode>();
+                        wireNode->name = sym;
                         wireNode->type = WIRE; 
-                        moduleNode->ports.push_back(wireNode);
+                        moduleNode->addPort(wireNode);
+                    }
+                    else if (port->type==WIRE) {
+                        // 跳过重复定义
+                        warn("Warning:定义的wire类型中存在重复名称");
+                    }
+                    else if (port->type==POWER) {
+                        throw std::runtime_error("Error:VCC,GND是保留关键字,Line "+lexer.getLine());
+                    }
+                    else if (port->type==INPUT || port->type==OUTPUT){
+                        throw std::runtime_error("Error不允许把输入/输出端口重定义为wire,Line "+lexer.getLine());
+                    }
+                    else {
+                        // module上列出但未声明类型的端口, 作为wire使用
+                        port->type = WIRE;
                     }
                 }
                 else {
-                    bool finded_port = false;
-                    for (auto& port : moduleNode->ports) {
-                        if (port->name == token.first) {
-                            finded_port = true;
-                            if(type == "input" || type == "output"){
-                                if(port->type==POWER){
-                                    throw std::runtime_error("Error:VCC,GND是保留关键字,Line "+lexer.getLine());
-                                }
-                                else if(port->type != UNDEF){
-                                    throw std::runtime_error("Error:对端口类型的重复定义,Line "+lexer.getLine());
-                                }
-                                port->type = type == "input" ? INPUT : OUTPUT;
-                            }
-                            else{
-                                throw std::runtime_error("Error端口类型错误,Line "+lexer.getLine());
-                            }
-                            break; // Exit the loop once the port is found and rewritten
+                    if(port == nullptr){
+                        throw std::runtime_error("Error:声明的输入/输出端口未在module上定义,Line "+lexer.getLine());
+                    }
+                    if(type == "input" || type == "output"){
+                        if(port->type==POWER){
+                            throw std::runtime_error("Error:VCC,GND是保留关键字,Line "+lexer.getLine());
+                        }
+                        else if(port->type != UNDEF){
+                            throw std::runtime_error("Error:对端口类型的重复定义,Line "+lexer.getLine());
                         }
+                        port->type = type == "input" ? INPUT : OUTPUT;
                     }
-                    if(!finded_port){
-                        throw std::runtime_error("Error:声明的输入/输出端口未在module上定义,Line "+lexer.getLine());
+                    else{
+                        throw std::runtime_error("Error端口类型错误,Line "+lexer.getLine());
                     }
                 }
             }
@@ -282,46 +1065,23 @@ private:
             }
         }
     }
-    void parseMos(const std::string type){
+    void parseMos(std::string_view type){
         // Mos mos;
-        moduleNode->mosfets.push_back(std::make_shared<MosNode>());
+        moduleNode->mosfets.push_back(moduleNode->make<MosNode>());
         auto mosNode=moduleNode->mosfets[moduleNode->mosfets.size()-1];
         mosNode->type=(type=="pmos")?PMOS:NMOS;
-        mosNode->name = (type=="pmos")?"p"+std::to_string(pcount++):"n"+std::to_string(ncount++);
+        mosNode->name = symbols().intern((type=="pmos")?"p"+std::to_string(pcount++):"n"+std::to_string(ncount++));
 
         expect("(");
-        mosNode->drain = lexer.getNextToken().first;
+        mosNode->drain = intern(lexer.getNextToken().first);
         expect(",");
-        mosNode->source = lexer.getNextToken().first;
+        mosNode->source = intern(lexer.getNextToken().first);
         expect(",");
-        mosNode->gate = lexer.getNextToken().first;
+        mosNode->gate = intern(lexer.getNextToken().first);
         
         expect(")");
         expect(";");
-        int def_port = 0;
-        for(auto&p:moduleNode->ports){
-            if(p->name==mosNode->drain||p->name==mosNode->source||p->name==mosNode->gate){
-                def_port++;
-            }
-        }
-        if(def_port<3){
-            throw std::runtime_error("Error:语句中有未定义的端口名,Line "+lexer.getLine());
-        }
-        
-        for(auto&port:moduleNode->ports){
-            if(port->name == mosNode->drain){
-                port->in.push_back(mosNode);
-                mosNode->_drain=port;
-            }
-            if(port->name == mosNode->source){
-                port->out.push_back(mosNode);
-                mosNode->_source=port;
-            }
-            if(port->name == mosNode->gate){
-                port->out.push_back(mosNode);
-                mosNode->_gate=port;
-            }
-        } 
+        connectMos(mosNode);
     }
     void parseNotes(){
         do{
@@ -331,213 +1091,128 @@ private:
             }
         }while(token.first!=";" && token.first!=")" && token.first!="endmodule");
     }
-    void parseModuleNesting(const std::string subModuleName){
+    // 实例化只记录子模块定义和端口绑定, 不复制子模块的晶体管(展开见ModuleNode::flatten)
+    void parseModuleNesting(std::string_view subModuleName){
         //必须在modules中已有定义
-        bool found=false;
-        std::vector<std::string> paras;//参数集
+        std::vector<Symbol> paras;//参数集
+        Symbol subModuleSym = intern(subModuleName);
         Token instanceToken = lexer.getNextToken();
         if(instanceToken.second != USER_DEF){
             throw std::runtime_error("Error: Expected instance name after module name, Line " + lexer.getLine());
         }
-        for(auto&m:modules){
-            if(m->name==subModuleName){
-                auto subModuleNode = std::make_shared<SubModuleNode>();
-                // 设置子模块信息
-                subModuleNode->module_name = subModuleName; // 记录模块名
-                subModuleNode->name = instanceToken.first;  // 实例名
-                
-                // auto it = std::find_if(moduleNode->subModules.begin(),moduleNode->subModules.end(),[&subModuleName](const std::shared_ptr<ModuleNode>& subM){
-                //     return subM->name == subModuleName;
-                // });
-                //添加子模块定义
-                // if(it == moduleNode->subModules.end()){
-                moduleNode->subModules.push_back(subModuleNode);
-                //moduleNode->subModuleCount++;
-                //收集参数
-                expect("(");
-                while((token=lexer.getNextToken()).first!=")"){
-                    if(token.second==USER_DEF){
-                        paras.push_back(token.first);
-                    }
-                    else if(token.first==","){
-                        continue;
-                    }
-                    else{
-                        throw std::runtime_error("Error:实例化语法错误,Line "+lexer.getLine());
-                    }
-                }
-                // 保存参数
-                subModuleNode->parameters = paras; // 记录参数列表
-                
-                expect(";");
-                int putSize=0;
-                for(auto&p:m->ports){
-                    if(p->type==INPUT || p->type==OUTPUT){
-                        putSize++;
-                    }
-                }
-                if(paras.size()!=putSize){
-                    throw std::runtime_error("用于实例化的参数数量错误,Line "+lexer.getLine());
-                }
-                //加入内部端口
-                for(auto&p:m->ports){
-                    if(p->type!=INPUT && p->type!=OUTPUT && p->type!=POWER){
-                        auto subPortNode = std::make_shared<PortNode>();
-                        subPortNode->name = instanceToken.first + "." + p->name;
-                        subPortNode->type = WIRE;
-                        moduleNode->ports.push_back(subPortNode);
-                        //加入子模块中
-                        subModuleNode->wirePorts.push_back(subPortNode);
-                    }
-                }
-                //加入晶体管
-                for(auto mos:m->mosfets){
-                    //提前定义
-                    moduleNode->mosfets.push_back(std::make_shared<MosNode>());
-                    auto subMosNode = moduleNode->mosfets[moduleNode->mosfets.size()-1];
-
-                    subMosNode->type = mos->type;
-                    subMosNode->name = instanceToken.first + "." + mos->name;
-                    subMosNode->drain = instanceToken.first + "." + mos->drain;
-                    subMosNode->source =  instanceToken.first + "." +mos->source;
-                    subMosNode->gate = instanceToken.first + "." + mos->gate;
-                    int def_port = 0;
-                    int put_seq = 0;
-                    for(auto&p:m->ports){  
-                        // 特殊处理：输入输出端口设定为参数值
-                        if(p->type == INPUT || p->type == OUTPUT){
-                            auto wrongPortName = instanceToken.first + "." + p->name;
-                            if(wrongPortName == subMosNode->drain){
-                                subMosNode->drain = paras[put_seq];
-                            }
-                            if(wrongPortName == subMosNode->source){
-                                subMosNode->source = paras[put_seq];
-                            }
-                            if(wrongPortName == subMosNode->gate){
-                                subMosNode->gate = paras[put_seq];
-                            }
-                            put_seq++;
-                        }
-                        // 特殊处理：power对象设定为默认值
-                        if(p->type == POWER){
-                            auto wrongPortName = instanceToken.first + "." + p->name;
-                            if(wrongPortName == subMosNode->drain){
-                                subMosNode->drain = p->name;
-                            }
-                            if(wrongPortName == subMosNode->source){
-                                subMosNode->source = p-> name;
-                            }
-                            if(wrongPortName == subMosNode->gate){
-                                subMosNode->gate = p->name;
-                            }
-                        }
-                        
-                    }
-                    for(auto&p:moduleNode->ports){  
-                        if(p->name==subMosNode->drain||p->name==subMosNode->source||p->name==subMosNode->gate){
-                            def_port++;
-                        }
-                    }
-                    if(def_port<3){
-                        throw std::runtime_error("Error:语句中有未定义的端口名,Line "+lexer.getLine());
-                    }
-                    for(auto&port:moduleNode->ports){
-                        if(port->name == subMosNode->drain){
-                            port->in.push_back(subMosNode);
-                            subMosNode->_drain=port;
-                        }
-                        if(port->name == subMosNode->source){
-                            port->out.push_back(subMosNode);
-                            subMosNode->_source=port;
-                        }
-                        if(port->name == subMosNode->gate){
-                            port->out.push_back(subMosNode);
-                            subMosNode->_gate=port;
-                        }
-                    }
-                    // 加入子模块中
-                    subModuleNode->mosfets.push_back(subMosNode);
-                }
-                int iop_index=0;
-                auto iop=m->ports[iop_index];
-                while(iop->type!=INPUT&&iop->type!=OUTPUT){
-                    iop=m->ports[++iop_index];
-                }
-                // 加入输入输出端口映射关系
-                for(int i=0;i<paras.size();++i){
-                    // 在模块端口中找到参数值
-                    for(auto&p:moduleNode->ports){
-                        if(p->name == paras[i]){  
-                            p->belongTo=subModuleNode;
-                            if(iop->type==INPUT){
-                                subModuleNode->inputPorts.push_back(p);
-                                break;
-                            }
-                            else if(iop->type==OUTPUT){
-                                subModuleNode->outputPorts.push_back(p);
-                                break;
-                            }
-                        }
-                    }
-                    iop=m->ports[++iop_index];
-                }
-                found=true;
-                break;
+        Symbol instanceSym = intern(instanceToken.first);
+        auto mit=definitions->find(subModuleSym);
+        if(mit==definitions->end() || (allowedDeps!=nullptr &&
+            std::find(allowedDeps->begin(),allowedDeps->end(),subModuleSym)==allowedDeps->end())){
+            throw std::runtime_error("Error:未定义的模组被实例化,Line "+lexer.getLine());
+        }
+        if(!instanceNames.insert(instanceSym).second){
+            throw std::runtime_error("Error:重复的实例名,Line "+lexer.getLine());
+        }
+        auto& m=mit->second;
+        auto subModuleNode = moduleNode->make<SubModuleNode>();
+        // 设置子模块信息
+        subModuleNode->module_name = subModuleSym; // 记录模块名
+        subModuleNode->name = instanceSym;  // 实例名
+        subModuleNode->module = m;
+        subModuleNode->portPos = moduleNode->ports.size();
+        subModuleNode->mosPos = moduleNode->mosfets.size();
+        moduleNode->subModules.push_back(subModuleNode);
+        //收集参数
+        expect("(");
+        while((token=lexer.getNextToken()).first!=")"){
+            if(token.second==USER_DEF){
+                paras.push_back(intern(token.first));
+            }
+            else if(token.first==","){
+                continue;
+            }
+            else{
+                throw std::runtime_error("Error:实例化语法错误,Line "+lexer.getLine());
             }
-            
         }
-        if(found){
-            ;
+        // 保存参数
+        subModuleNode->parameters = paras; // 记录参数列表
+        
+        expect(";");
+        // 子模块的输入输出端口(按端口顺序), 与参数一一对应
+        std::vector<PortNode*> ioPorts;
+        for(auto&p:m->ports){
+            if(p->type==INPUT || p->type==OUTPUT){
+                ioPorts.push_back(p);
+            }
         }
-        else{
-            throw std::runtime_error("Error:未定义的模组被实例化,Line "+lexer.getLine());
+        if(paras.size()!=ioPorts.size()){
+            throw std::runtime_error("用于实例化的参数数量错误,Line "+lexer.getLine());
+        }
+        // 加入输入输出端口映射关系
+        for(size_t i=0;i<paras.size();++i){
+            // 在模块端口中找到参数值
+            auto p=moduleNode->findPort(paras[i]);
+            if(p==nullptr){
+                throw std::runtime_error("Error:语句中有未定义的端口名,Line "+lexer.getLine());
+            }
+            p->belongTo=subModuleNode;
+            if(ioPorts[i]->type==INPUT){
+                subModuleNode->inputPorts.push_back(p);
+            }
+            else{
+                subModuleNode->outputPorts.push_back(p);
+            }
         }
     }
     // 只接受期望的Token
     void expect(const std::string& expectedToken) {
         token = lexer.getNextToken();
         if (token.first != expectedToken) {
-            throw std::runtime_error("Expected \"" + expectedToken + "\", but got \"" + token.first+"\",Line "+lexer.getLine());
+            throw std::runtime_error("Expected \"" + expectedToken + "\", but got \"" + std::string(token.first)+"\",Line "+lexer.getLine());
+        }
+    }
+    void connectMos(MosNode* mosNode){
+        if(!moduleNode->connectMos(mosNode)){
+            throw std::runtime_error("Error:语句中有未定义的端口名,Line "+lexer.getLine());
         }
     }
     // 删除没有连接对象的端口：1.VCC和GND未使用 2.用户定义了未使用的端口
+    // 作为实例参数的端口, 以及子模块定义中用到的VCC/GND, 展开后会有连接, 不算未使用
     void removeEmptyPort(){
-        std::vector<std::shared_ptr<PortNode>> to_remove;
-        // 收集需要删除的元素
-        for (const auto& port : moduleNode->ports) {
-            if (port != nullptr && port->in.empty() && port->out.empty()) {
+        std::unordered_set<Symbol> bound;
+        for(auto&sub:moduleNode->subModules){
+            bound.insert(sub->parameters.begin(),sub->parameters.end());
+            for(Symbol power:{SYM_VCC,SYM_GND}){
+                if(sub->module->findPort(power)!=nullptr){
+                    bound.insert(power);
+                }
+            }
+        }
+        std::vector<size_t> removedBefore(moduleNode->ports.size()+1,0);
+        std::unordered_set<PortNode*> to_remove;
+        for(size_t i=0;i<moduleNode->ports.size();i++){
+            auto& port=moduleNode->ports[i];
+            removedBefore[i+1]=removedBefore[i];
+            if (port->in.empty() && port->out.empty() && !bound.count(port->name)) {
                 if(port->type!=POWER){
-                    std::cout<<"Warning:定义的端口未使用-"<<port->name<<",Line "+lexer.getLine()<<std::endl;
+                    warn("Warning:定义的端口未使用-"+symName(port->name));
                 }
-                to_remove.push_back(port);
+                to_remove.insert(port);
+                removedBefore[i+1]++;
             }
         }
-        // 删除收集到的元素
-        for (const auto& port : to_remove) {
-            moduleNode->ports.erase(
-                std::remove(moduleNode->ports.begin(), moduleNode->ports.end(), port),
-                moduleNode->ports.end()
-            );
+        for(auto&sub:moduleNode->subModules){
+            sub->portPos-=removedBefore[sub->portPos];
         }
+        moduleNode->removePortsIf([&](PortNode* port){
+            return to_remove.count(port)>0;
+        });
     }
     void AddPuts(){
-        int putCount=0;
-        for(auto&p:moduleNode->ports){
-            if(p->type==INPUT){
-                moduleNode->inputs.push_back(p);
-            }
-            else if(p->type==OUTPUT){
-                moduleNode->outputs.push_back(p);
-            }
-            else if(p->type==WIRE){
-                break;
-            }
-        }
+        moduleNode->collectPuts();
     }
     // 分析新模组前的重置
     void resetModule(){
         pcount=1;
         ncount=1;
+        instanceNames.clear();
     }
 };
 // TODO：采用字节缓冲读取方法
@@ -573,18 +1248,246 @@ private:
 //     file.close();
 // }
 
+// 服务模式(--server): 从stdin逐行读入json请求, 每个请求向stdout输出一行json应答. 解析和编译的结果
+// 留在内存中, 之后的仿真请求不再解析源文件. 请求中的id原样带回; 出错时应答为{"ok": false, "error": ...}
+//   {"cmd": "load", "design": d, "file": 路径 | "source": 源代码}  解析(替换同名的设计), 返回各模块的端口
+//   {"cmd": "simulate", "design": d, "module": m, "inputs": "01XZ..." | {"a": "1", ...}}  一组输入, 增量仿真
+//   {"cmd": "batch", "design": d, "module": m, "vectors": ["01XZ...", ...]}  多组输入, 位并行仿真
+//   {"cmd": "page", "design": d, "module": m, "begin": a, "count": n}  真值表第a行起的n行(最多SIM_CHUNK行)
+//   {"cmd": "quit"}
+// design省略时为最近一次load的设计; 输入按模块的输入端口顺序给出
+struct ServerDesign {
+    std::string source;
+    std::unique_ptr<Lexer> lexer;
+    std::unique_ptr<Parser> parser;
+    std::unordered_map<std::string, ModuleNode*> modules;  // 模块名到展开后的模块
+};
+
+class SimServer {
+public:
+    explicit SimServer(unsigned threads) : threads(threads) {}
+
+    void run(std::istream& in, std::ostream& out) {
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+            json reply;
+            bool quit = false;
+            try {
+                json request = json::parse(line);
+                if (request.contains("id")) reply["id"] = request["id"];
+                reply["ok"] = true;
+                std::string cmd = request.value("cmd", "");
+                if (cmd == "load") load(request, reply);
+                else if (cmd == "simulate") simulate(request, reply);
+                else if (cmd == "batch") batch(request, reply);
+                else if (cmd == "page") page(request, reply);
+                else if (cmd == "quit") quit = true;
+                else throw std::runtime_error("Error:未知的请求" + cmd);
+            } catch (const std::exception& e) {
+                json error;
+                if (reply.contains("id")) error["id"] = reply["id"];
+                error["ok"] = false;
+                error["error"] = e.what();
+                reply = std::move(error);
+            }
+            out << reply.dump() << '\n';
+            out.flush();
+            if (quit) return;
+        }
+    }
+
+private:
+    void load(const json& request, json& reply) {
+        auto design = std::make_unique<ServerDesign>();
+        std::string name = "default";
+        if (request.contains("file")) {
+            std::string path = request["file"].get<std::string>();
+            std::ifstream file(path, std::ios::binary);
+            if (!file.is_open()) throw std::runtime_error("Error:无法打开" + path);
+            design->source.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            name = path;
+        } else {
+            design->source = request.at("source").get<std::string>();
+        }
+        name = request.value("design", name);
+        design->lexer = std::make_unique<Lexer>(std::string_view(design->source));
+        design->parser = std::make_unique<Parser>(*design->lexer);
+        std::ostringstream warnings;
+        design->parser->setLog(warnings);
+        design->parser->setThreads(threads);
+        design->parser->parse();
+        json modules = json::array();
+        for (auto& m : design->parser->getModules()) {
+            ModuleNode* flat = m->flatten();
+            design->modules[symName(flat->name)] = flat;
+            json info;
+            info["name"] = symName(flat->name);
+            info["inputs"] = portNames(flat->inputs);
+            info["outputs"] = portNames(flat->outputs);
+            info["mosfets"] = flat->mosfets.size();
+            modules.push_back(std::move(info));
+        }
+        designs[name] = std::move(design);
+        current = name;
+        reply["design"] = name;
+        reply["modules"] = std::move(modules);
+        reply["warnings"] = warnings.str();
+    }
+    void simulate(const json& request, json& reply) {
+        ModuleNode* m = module(request);
+        std::vector<STATE> in(m->inputs.size());
+        const json& inputs = request.at("inputs");
+        if (inputs.is_string()) {
+            std::string v = inputs.get<std::string>();
+            if (v.size() != in.size()) throw std::runtime_error("Error:输入数应为" + std::to_string(in.size()));
+            for (size_t j = 0; j < in.size(); j++) in[j] = value(v[j]);
+        } else {
+            for (size_t j = 0; j < in.size(); j++) {
+                std::string v = inputs.at(symName(m->inputs[j]->name)).get<std::string>();
+                in[j] = v.size() == 1 ? value(v[0]) : ERROR;
+                if (in[j] == ERROR) throw std::runtime_error("Error:输入取值应为0/1/Z/X");
+            }
+        }
+        reply["evaluated"] = m->trigger(in);
+        json outputs = json::object();
+        for (auto& p : m->outputs) outputs[symName(p->name)] = std::string(1, retranslate(p->state));
+        reply["outputs"] = std::move(outputs);
+    }
+    void batch(const json& request, json& reply) {
+        ModuleNode* m = module(request);
+        const SimNetlist& net = m->compiled();
+        SimVM vm(net, m->bytecode());
+        const json& vectors = request.at("vectors");
+        size_t n = net.inputs.size();
+        std::vector<uint64_t> zeros(n * SIM_WORDS), ones(n * SIM_WORDS);
+        json outputs = json::array();
+        std::string row;
+        for (size_t base = 0; base < vectors.size(); base += SIM_BLOCK) {
+            size_t lanes = std::min<size_t>(SIM_BLOCK, vectors.size() - base);
+            std::fill(zeros.begin(), zeros.end(), 0);
+            std::fill(ones.begin(), ones.end(), 0);
+            for (size_t lane = 0; lane < lanes; lane++) {
+                std::string v = vectors[base + lane].get<std::string>();
+                if (v.size() != n) throw std::runtime_error("Error:第" + std::to_string(base + lane) + "组的输入数应为" + std::to_string(n));
+                uint64_t bit = 1ull << (lane % 64);
+                for (size_t j = 0; j < n; j++) {
+                    STATE s = value(v[j]);
+                    if (s == ZERO || s == X) zeros[j * SIM_WORDS + lane / 64] |= bit;
+                    if (s == ONE || s == X) ones[j * SIM_WORDS + lane / 64] |= bit;
+                }
+            }
+            vm.runPlanes(zeros.data(), ones.data());
+            for (size_t lane = 0; lane < lanes; lane++) {
+                row.clear();
+                for (uint32_t p : net.outputs) row += retranslate(vm.state(p, lane));
+                outputs.push_back(row);
+            }
+        }
+        reply["outputs"] = std::move(outputs);
+    }
+    // 与--rows --json中一张表的内容相同
+    void page(const json& request, json& reply) {
+        ModuleNode* m = module(request);
+        const SimNetlist& net = m->compiled();
+        size_t n = net.inputs.size();
+        uint64_t rows = n < 63 ? 1ull << n : 0;
+        uint64_t begin = std::min(request.value("begin", uint64_t(0)), rows);
+        uint64_t end = begin + std::min(request.value("count", SIM_BLOCK), rows - begin);
+        end = std::min(end, begin + SIM_CHUNK);
+        SimVM vm(net, m->bytecode());
+        json data = json::array();
+        std::string ins, outs;
+        for (uint64_t base = begin / SIM_BLOCK * SIM_BLOCK; base < end; base += SIM_BLOCK) {
+            vm.runBlock(base);
+            for (uint64_t row = std::max(base, begin); row < std::min(base + SIM_BLOCK, end); row++) {
+                ins.clear();
+                outs.clear();
+                for (size_t j = 0; j < n; j++) ins += static_cast<char>('0' + ((row >> j) & 1));
+                for (uint32_t p : net.outputs) outs += retranslate(vm.state(p, row - base));
+                data.push_back({ins, outs});
+            }
+        }
+        reply["module"] = symName(m->name);
+        reply["inputs"] = portNames(m->inputs);
+        reply["outputs"] = portNames(m->outputs);
+        reply["rows"] = rows;
+        reply["begin"] = begin;
+        reply["data"] = std::move(data);
+    }
+
+    ModuleNode* module(const json& request) {
+        std::string name = request.value("design", current);
+        auto it = designs.find(name);
+        if (it == designs.end()) throw std::runtime_error("Error:未载入设计" + name);
+        std::string module = request.at("module").get<std::string>();
+        auto m = it->second->modules.find(module);
+        if (m == it->second->modules.end()) throw std::runtime_error("Error:设计" + name + "中没有模块" + module);
+        return m->second;
+    }
+    static STATE value(char c) {
+        STATE s = translate_cin(c);
+        if (s == ERROR) throw std::runtime_error("Error:输入取值应为0/1/Z/X");
+        return s;
+    }
+    static json portNames(const std::vector<PortNode*>& ports) {
+        json names = json::array();
+        for (auto& p : ports) names.push_back(symName(p->name));
+        return names;
+    }
+
+    unsigned threads;
+    std::map<std::string, std::unique_ptr<ServerDesign>> designs;
+    std::string current;
+};
+
 void options_helper() {
     std::cout << "You can use the following options\n";
     std::cout << "-h (help): 命令行选项实用信息\n";
-    std::cout << "-f (file) <addr>: 需解析的文件路径\n";
+    std::cout << "-f (file) <addr>: 需解析的文件路径, \"-\" 表示从stdin读取\n";
     std::cout << "-s (shell): 在终端打印真值表\n";
     std::cout << "-m (markdown): 将真值表打印到md文件\n";
+    std::cout << "-mb (binary table): 同-m, 但输出二进制真值表<文件>.tt(每个输出2位, 每行定长, 可按行号直接读取), 可与-o/-r/-g同用\n";
+    std::cout << "--rows <a>:<b>: 不解析源文件, 从<文件>.tt中读出第a到b-1行\n";
+    std::cout << "--module <name>: 与--rows同用, 只输出该模块的表\n";
+    std::cout << "--json: 与--rows同用, 以一个json对象输出(不输出选项回显)\n";
     std::cout << "-c (conversation): 交互式查询\n";
+    std::cout << "-o (output cones): 与-m/-s同用, 每个输出只对它结构上依赖的输入穷举, 依赖相同的输出合为一张表\n";
+    std::cout << "-r (random) <n>: 与-m/-s同用, 行数超过n的表改为随机抽取n组输入仿真\n";
+    std::cout << "-rs (random seed) <n>: -r的随机数种子, 默认为1\n";
+    std::cout << "-rb (random bias) <a=p,b=p...>: -r时输入取1的概率, 0或1表示固定该输入, 默认为0.5\n";
+    std::cout << "-g (gray): 与-m/-s同用, 按格雷码顺序逐行增量仿真(每行只改变一个输入), 输出仍按自然顺序\n";
+    std::cout << "-t (timing): 比较各仿真引擎(事件驱动/分量查表/位并行/字节码)对每个模块的速度(vectors/s)\n";
+    std::cout << "-a (analyze): 识别静态CMOS门(反相器/与非/或非/与或非等), 报告每个模块的识别覆盖率\n";
+    std::cout << "-y (symbolic): 不穷举, 用BDD求每个输出取0/1/Z/X的行数, 并随机抽取几行显示, 适用于输入很多的模块\n";
+    std::cout << "-e (equivalence) <a>,<b>: 用BDD检查模块a与b是否等价(输入输出按名称对应), 不等价时给出一组反例\n";
+    std::cout << "-v (vectors) <addr>: 仿真激励文件中的每组输入(每行一组, 或二进制位矩阵), 输出写到<激励文件>.out, 并报告速度(vectors/s)\n";
+    std::cout << "-vm (vector module) <name>: -v所仿真的模块, 默认为最后一个模块\n";
+    std::cout << "--server: 服务模式, 从stdin逐行读入json请求(load/simulate/batch/page/quit), 每个请求输出一行json应答, 不需要-f\n";
     std::cout << "-d (dump): 解析并输出json文件\n";
+    std::cout << "-dc (dump compact): 同-d, 但输出不带换行缩进的紧凑json\n";
+    std::cout << "-b (binary): 输出二进制网表<文件>.netbin, 内容与json相同, 可直接交给TestRoute -f\n";
+    std::cout << "-l (lex): 仅做词法分析, 输出token数量与速度(tokens/s)\n";
+    std::cout << "-j (jobs) <n>: 并行解析和仿真的线程数, 默认为CPU核数\n";
+    std::cout << "-i (incremental): 使用<文件>.cache缓存解析结果, 只重新解析改动的模块及依赖它们的模块\n";
     exit(0);
 }
 
-int main(int argc, char* argv[]){
+// 十进制非负整数(不接受符号、空白和多余字符)
+bool parseUnsigned(const std::string& text, uint64_t& value) {
+    if (text.empty() || text.size() > 20) return false;
+    uint64_t v = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9') return false;
+        uint64_t d = static_cast<uint64_t>(c - '0');
+        if (v > (UINT64_MAX - d) / 10) return false;
+        v = v * 10 + d;
+    }
+    value = v;
+    return true;
+}
+
+int main(int argc, char* argv[]) try {
     std::map<std::string, std::string> options;
     if (argc == 1) {
         options_helper();
@@ -595,10 +1498,10 @@ int main(int argc, char* argv[]){
         if (param[0] == '-') {
             if (param == "-h") {
                 options_helper();
-            } else if (param == "-f") {
+            } else if (param == "-f" || param == "-j" || param == "-e" || param == "-r" || param == "-rs" || param == "-rb" || param == "-v" || param == "-vm" || param == "--rows" || param == "--module") {
                 if (i != argc - 1) options[param] = argv[++i];
                 else options_helper();
-            } else if (param == "-m" || param == "-s" || param == "-c" || param == "-d") {
+            } else if (param == "-m" || param == "-s" || param == "-c" || param == "-d" || param == "-dc" || param == "-b" || param == "-l" || param == "-i" || param == "-g" || param == "-t" || param == "-a" || param == "-o" || param == "-y" || param == "-mb" || param == "--json" || param == "--server") {
                 options[param] = "";
             }
         } else {
@@ -606,34 +1509,125 @@ int main(int argc, char* argv[]){
         }
     }
 
-    for (auto& pair : options) {
-        std::cout << pair.first << ": " << pair.second << "\n";
+    // --json/--server的输出只有json本身
+    if (!options.count("--json") && !options.count("--server")) {
+        for (auto& pair : options) {
+            std::cout << pair.first << ": " << pair.second << "\n";
+        }
     }
 
+    if (options.count("--server")) {
+        unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+        if (options.count("-j")) threads = std::max(1, std::stoi(options["-j"]));
+        SimServer server(threads);
+        server.run(std::cin, std::cout);
+        return 0;
+    }
     if (options.count("-f") == 0) {
         options_helper();
     }
+    // -r: 抽样的行数、种子和各输入的偏置, 在解析前检查
+    uint64_t samples = 0, seed = 1;
+    std::map<std::string, double> bias;
+    if (!options.count("-r") && (options.count("-rs") || options.count("-rb"))) {
+        throw std::runtime_error("Error:-rs和-rb须与-r同用");
+    }
+    if (options.count("-r")) {
+        if (!parseUnsigned(options["-r"], samples) || samples == 0) {
+            throw std::runtime_error("Error:-r的行数应为正整数: " + options["-r"]);
+        }
+        if (options.count("-rs") && !parseUnsigned(options["-rs"], seed)) {
+            throw std::runtime_error("Error:-rs的种子应为非负整数: " + options["-rs"]);
+        }
+        std::stringstream spec(options["-rb"]);
+        std::string item;
+        while (std::getline(spec, item, ',')) {
+            size_t eq = item.find('=');
+            double p = -1;
+            if (eq != std::string::npos && eq > 0 && eq + 1 < item.size()) {
+                char* end = nullptr;
+                p = std::strtod(item.c_str() + eq + 1, &end);
+                if (*end != '\0') p = -1;
+            }
+            if (!(p >= 0 && p <= 1)) {
+                throw std::runtime_error("Error:-rb的格式应为 输入名=概率(0到1), 如 a=1,b=0.25: " + item);
+            }
+            bias[item.substr(0, eq)] = p;
+        }
+    }
     // 检查是否提供了文件名
     std::string input_file = options["-f"];
-    std::ifstream file(input_file);
+    // --rows: 直接从-mb生成的<文件>.tt中取出一段行, 不重新解析和仿真
+    if (options.count("--rows")) {
+        std::string range = options["--rows"];
+        size_t colon = range.find(':');
+        uint64_t begin = 0, end = 0;
+        if (colon == std::string::npos || !parseUnsigned(range.substr(0, colon), begin) ||
+            !parseUnsigned(range.substr(colon + 1), end) || begin > end) {
+            options_helper();
+        }
+        MappedFile tt;
+        if (!tt.open(input_file + ".tt")) {
+            std::cout << "fail to open " << input_file + ".tt" << std::endl;
+            exit(1);
+        }
+        TruthTableFile tables(tt);
+        writeTableRows(tables, options["--module"], begin, end, options.count("--json"), std::cout);
+        return 0;
+    }
+    MappedFile mapped;
+    std::ifstream file;
+    std::unique_ptr<Lexer> lexer;
 
-    // 读入文件相关
-    if(!file.is_open()){
-        std::cout << "fail to open " << options["-f"] << std::endl;
-        exit(1);
+    // 读入文件相关: 默认内存映射, "-" 表示从stdin读取, 无法映射时退回流读取
+    if (input_file == "-") {
+        input_file = "stdin";
+        lexer = std::make_unique<Lexer>(std::cin);
+    } else if (mapped.open(input_file)) {
+        lexer = std::make_unique<Lexer>(mapped.view());
+    } else {
+        file.open(input_file);
+        if(!file.is_open()){
+            std::cout << "fail to open " << options["-f"] << std::endl;
+            exit(1);
+        }
+        lexer = std::make_unique<Lexer>(file);
+    }
+    if (options.count("-l")) {
+        auto start = std::chrono::steady_clock::now();
+        long long count = 0;
+        while (lexer->getNextToken().second != NONE) count++;
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "tokens: " << count << ", time: " << secs << " s, "
+                  << (secs > 0 ? count / secs : 0) << " tokens/s\n";
+        return 0;
+    }
+    Parser parser(*lexer);
+    unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+    if (options.count("-j")) {
+        jobs = std::max(1, std::stoi(options["-j"]));
+    }
+    parser.setThreads(jobs);
+    ModuleCache cache;
+    if (options.count("-i") && lexer->buffered()) {
+        parser.useCache(cache, input_file + ".cache");
     }
-    Lexer lexer(file);
-    Parser parser(lexer);
     parser.parse();
-    json ast=parser.toJSON();
     file.close();
 
-    if (options.count("-d")) {
+    if (options.count("-d") || options.count("-dc")) {
         std::string dump_name = input_file + ".json";
         std::ofstream output_file(dump_name);
-        output_file << ast.dump(4);
+        parser.writeJSON(output_file, options.count("-d") ? 4 : -1);
         output_file.close();
     }
+    if (options.count("-b")) {
+        std::ofstream output_file(input_file + ".netbin", std::ios::binary);
+        if (!output_file.is_open() || !parser.writeNetlist(output_file)) {
+            std::cout << "fail to write " << input_file + ".netbin" << std::endl;
+            exit(1);
+        }
+    }
 
     if (options.count("-c")) {
         bool loop = true;
@@ -641,9 +1635,9 @@ int main(int argc, char* argv[]){
             std::cout << "Select one module: (enter its index)\n";
 
             // ASK: return &
-            std::vector<std::shared_ptr<ModuleNode>> modules = parser.getModules();
+            std::vector<ModuleNode*> modules = parser.getModules();
             for (int i = 0; i < modules.size(); i++) {
-                std::cout << i + 1 << "." << modules[i]->name << "\t";
+                std::cout << i + 1 << "." << symName(modules[i]->name) << "\t";
             }
             std::cout << "\n";
             
@@ -651,7 +1645,7 @@ int main(int argc, char* argv[]){
             std::cin >> idx;
 
             if (idx > 0 && idx <= modules.size()) {
-                modules[idx-1]->conversation();
+                modules[idx-1]->flatten()->conversation();
             } else {
                 std::cout << "Invalid index\n";
             }
@@ -670,6 +1664,59 @@ int main(int argc, char* argv[]){
             
         }
     }
+    if (options.count("-a")) {
+        for (auto& i : parser.getModules()) {
+            reportGates(i->flatten(), std::cout);
+        }
+    }
+    if (options.count("-y")) {
+        for (auto& i : parser.getModules()) {
+            reportSymbolic(i->flatten(), std::cout);
+        }
+    }
+    if (options.count("-e")) {
+        std::string pair = options["-e"];
+        size_t comma = pair.find(',');
+        ModuleNode* a = nullptr;
+        ModuleNode* b = nullptr;
+        for (auto& i : parser.getModules()) {
+            if (comma != std::string::npos && symName(i->name) == pair.substr(0, comma)) a = i;
+            if (comma != std::string::npos && symName(i->name) == pair.substr(comma + 1)) b = i;
+        }
+        if (a == nullptr || b == nullptr) {
+            std::cout << "Invalid modules: " << pair << "\n";
+            exit(1);
+        }
+        checkEquivalence(a->flatten(), b->flatten(), std::cout);
+    }
+    if (options.count("-v")) {
+        ModuleNode* top = nullptr;
+        for (auto& i : parser.getModules()) {
+            if (!options.count("-vm") || symName(i->name) == options["-vm"]) top = i;
+        }
+        if (top == nullptr) {
+            std::cout << "Invalid module: " << options["-vm"] << "\n";
+            exit(1);
+        }
+        MappedFile stimulus;
+        std::ofstream result(options["-v"] + ".out", std::ios::binary);
+        if (!stimulus.open(options["-v"]) || !result.is_open()) {
+            std::cout << "fail to open " << options["-v"] << std::endl;
+            exit(1);
+        }
+        top = top->flatten();
+        auto start = std::chrono::steady_clock::now();
+        uint64_t count = simulateStimulus(top, stimulus, result);
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << options["-v"] + ".out\n";
+        std::cout << "module " << symName(top->name) << ": vectors: " << count << ", time: " << secs << " s, "
+                  << (secs > 0 ? count / secs : 0) << " vectors/s\n";
+    }
+    if (options.count("-t")) {
+        for (auto& i : parser.getModules()) {
+            benchmarkEngines(i->flatten(), std::cout);
+        }
+    }
     if (options.count("-m")) {
         std::ofstream md_file(input_file + ".md");
         if (!md_file.is_open()) {
@@ -679,19 +1726,52 @@ int main(int argc, char* argv[]){
         std::cout << input_file + ".md\n";
         md_file.clear();
         md_file << "# Simulation of " << options["-f"] << "\n"; 
+        // 先在本线程展开全部模块(flatten的结果缓存不是线程安全的), 再并行仿真
+        TableWriter table(md_file, TABLE_MARKDOWN, options.count("-g"));
+        table.sampling(samples, seed, bias);
         for (auto& i : parser.getModules()) {
-            md_file << "## module " << i->name << "\n";
-            i->simulate_all_to_file(md_file);
-            md_file << "\n";
+            table.text("## module " + symName(i->name) + "\n");
+            if (options.count("-o")) table.cones(i->flatten());
+            else table.module(i->flatten());
+            table.text("\n");
         }
+        table.run(jobs);
         md_file.close();
     }
+    if (options.count("-mb")) {
+        std::ofstream tt_file(input_file + ".tt", std::ios::binary);
+        if (!tt_file.is_open()) {
+            std::cout << "fail to open " << input_file + ".tt" << std::endl;
+            exit(1);
+        }
+        std::cout << input_file + ".tt\n";
+        TableWriter table(tt_file, TABLE_BINARY, options.count("-g"));
+        table.sampling(samples, seed, bias);
+        for (auto& i : parser.getModules()) {
+            if (options.count("-o")) table.cones(i->flatten());
+            else table.module(i->flatten());
+        }
+        table.run(jobs);
+        tt_file.close();
+    }
     if (options.count("-s")) {
+        TableWriter table(std::cout, TABLE_TEXT, options.count("-g"));
+        table.sampling(samples, seed, bias);
         for (auto& i : parser.getModules()) {
-            std::cout << "module " << i->name << std::endl;
-            i->simulate_all();
-            std::cout << "\n";
+            table.text("module " + symName(i->name) + "\n");
+            if (options.count("-o")) table.cones(i->flatten());
+            else table.module(i->flatten());
+            table.text("\n");
         }
+        std::cout.flush();
+        table.run(jobs);
+    }
+    if (options.count("-i")) {
+        parser.saveCache();
     }
     return 0;
+} catch (const std::exception& e) {
+    // 解析和仿真中的错误: 输出信息并以非0返回
+    std::cerr << e.what() << std::endl;
+    return 1;
 }
\ No newline at end of file
@@ -4,12 +4,20 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
-#include <regex>
 #include <fstream>
 #include <map>
 #include <memory>
+#include <deque>
+#include <unordered_map>
+#include <string_view>
+#include <cstdint>
+#include <shared_mutex>
+#include <mutex>
+#include <algorithm>
+#include <cmath>
 
 #include "json.hpp"
+#include "arena.hpp"
 using json=nlohmann::ordered_json;
 
 #define UNDEF ""
@@ -32,7 +40,9 @@ enum TokenType {
     KEYWORD,
     USER_DEF,
     SYMBOL,
-    NONE
+    NONE,
+    NUMBER,
+    OTHER
 };
 enum STATE{
     ZERO,
@@ -67,9 +77,75 @@ char retranslate(STATE x) {
     throw std::runtime_error("retranslate fail");
 }
 
+// 全局符号表: 每个标识符只保存一份, AST中以稠密的32位ID引用, 输出时才解析回字符串
+using Symbol = uint32_t;
+class SymbolTable {
+public:
+    SymbolTable() {
+        intern("VCC");
+        intern("GND");
+    }
+    // 可被多个解析线程同时调用: 已存在的名称只需读锁
+    Symbol intern(std::string_view s) {
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            auto it = ids.find(s);
+            if (it != ids.end()) return it->second;
+        }
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        auto it = ids.find(s);
+        if (it != ids.end()) return it->second;
+        Symbol id = static_cast<Symbol>(names.size());
+        // deque保证已有字符串地址不变, 可作为map的键
+        names.emplace_back(s);
+        ids.emplace(names.back(), id);
+        return id;
+    }
+    // 层次化名称 inst.name
+    Symbol intern(Symbol prefix, Symbol name) {
+        const std::string& p = str(prefix);
+        const std::string& n = str(name);
+        std::string full;
+        full.reserve(p.size() + 1 + n.size());
+        full.append(p).append(1, '.').append(n);
+        return intern(full);
+    }
+    const std::string& str(Symbol id) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return names[id];
+    }
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return names.size();
+    }
+private:
+    mutable std::shared_mutex mutex;
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, Symbol> ids;
+};
+inline SymbolTable& symbols() {
+    static SymbolTable table;
+    return table;
+}
+inline const std::string& symName(Symbol id) { return symbols().str(id); }
+const Symbol SYM_VCC = 0;
+const Symbol SYM_GND = 1;
+
+class JsonWriter;
+struct SimNetlist;
+struct LevelNetlist;
+struct SimProgram;
+struct MacroModel;
+struct MacroNetlist;
+class EventSim;
+class LevelSim;
+class MacroSim;
+
 // 定义AST节点结构
 struct ASTNode {
     virtual json toJSON() const = 0;
+    // 不建立json对象, 直接输出与toJSON相同的内容
+    virtual void writeJSON(JsonWriter& w) const = 0;
 };
 struct PortNode;
 struct SubModuleNode;
@@ -77,137 +153,156 @@ struct ModuleNode;
 struct MosNode:public ASTNode
 {
     int type;
-    std::string name;
-    std::string drain;
-    std::string source;
-    std::string gate;
-    std::shared_ptr<PortNode> _drain;
-    std::shared_ptr<PortNode> _source;
-    std::shared_ptr<PortNode> _gate;
+    Symbol name;
+    Symbol drain;
+    Symbol source;
+    Symbol gate;
+    PortNode* _drain = nullptr;
+    PortNode* _source = nullptr;
+    PortNode* _gate = nullptr;
 
     json toJSON() const override;
-
-    void trigger();
+    void writeJSON(JsonWriter& w) const override;
 };
 
 struct PortNode:public ASTNode
 {
     std::string type;// = 0;
-    std::string name;
-    std::vector<std::shared_ptr<MosNode>> in;
-    std::vector<std::shared_ptr<MosNode>> out;
+    Symbol name;
+    std::vector<MosNode*> in;
+    std::vector<MosNode*> out;
     // TODO:一个端口属于多个子模块(这可能吗？)
-    std::shared_ptr<SubModuleNode> belongTo;
+    SubModuleNode* belongTo = nullptr;
     
     STATE state;
 
     json toJSON() const override;
-
-    void trigger(STATE new_state);
+    void writeJSON(JsonWriter& w) const override;
 };
 struct SubModuleNode
 {
-    std::string name;
-    std::string module_name; // 添加模块名
-    std::vector<std::string> parameters; // 添加参数列表
-    std::vector<std::shared_ptr<PortNode>> inputPorts;
-    std::vector<std::shared_ptr<PortNode>> outputPorts;
+    Symbol name;
+    Symbol module_name; // 添加模块名
+    std::vector<Symbol> parameters; // 添加参数列表
+    ModuleNode* module = nullptr; // 被实例化的模块定义(多个实例共享)
+    // 实例化时本模块已有的端口/晶体管数量, 展开时据此保持原来的先后顺序
+    size_t portPos = 0;
+    size_t mosPos = 0;
+    // 以下在展开后的模块中才填充晶体管与内部端口
+    std::vector<PortNode*> inputPorts;
+    std::vector<PortNode*> outputPorts;
 
-    std::vector<std::shared_ptr<PortNode>> wirePorts;
-    std::vector<std::shared_ptr<MosNode>> mosfets;
+    std::vector<PortNode*> wirePorts;
+    std::vector<MosNode*> mosfets;
 
     json toJSON() const; // 添加toJSON方法
+    void writeJSON(JsonWriter& w) const;
 };
 struct ModuleNode : public ASTNode
 {
-    std::string name;
-    std::vector<std::shared_ptr<PortNode>> inputs;
-    std::vector<std::shared_ptr<PortNode>> outputs;
-    std::vector<std::shared_ptr<PortNode>> ports;
-    std::vector<std::shared_ptr<MosNode>> mosfets;
-    std::vector<std::shared_ptr<SubModuleNode>> subModules;
+    Symbol name;
+    std::vector<PortNode*> inputs;
+    std::vector<PortNode*> outputs;
+    std::vector<PortNode*> ports;
+    std::vector<MosNode*> mosfets;
+    std::vector<SubModuleNode*> subModules;
+    // 名称到端口的索引, 与ports保持同步(通过addPort/removePortsIf修改ports)
+    std::unordered_map<Symbol, PortNode*> portIndex;
     //int subModuleCount=0;
+    // 解析得到的是模块定义: ports/mosfets只含本模块自己声明的部分, 子模块只记录实例;
+    // 仿真和输出json前需调用flatten()得到展开后的模块(结果缓存于flat)
+    ModuleNode* flat = nullptr;
+    // 编译后的仿真网表(首次仿真时生成)
+    SimNetlist* sim = nullptr;
+    // 按沟道连通分量编译的网表(首次交互仿真时生成)
+    LevelNetlist* levels = nullptr;
+    // 编译后的字节码(首次使用时生成)
+    SimProgram* program = nullptr;
+    // 作为子模块时的宏模型(输入到输出的查找表), 以及按宏模型组织的本模块网表(展开后的模块才有)
+    MacroModel* macro = nullptr;
+    MacroNetlist* macros = nullptr;
+    // 交互查询的仿真状态, 保留上次的结果用于增量更新
+    EventSim* session = nullptr;
+    LevelSim* levelSession = nullptr;
+    MacroSim* macroSession = nullptr;
+    // 本模块(及其展开结果)的端口、晶体管和实例都分配在这里, 随模块一起释放
+    Arena arena;
 
     json toJSON() const override;
+    void writeJSON(JsonWriter& w) const override;
+    ModuleNode* flatten();
+    template <class T>
+    T* make() {
+        return arena.make<T>();
+    }
 
-    int getInputIndex(const std::string& str) {
-        auto it = std::lower_bound(inputs.begin(), inputs.end(), str, 
-            [](const std::shared_ptr<PortNode>& node, const std::string& value) {
-                return node->name < value;
-            }
-        );
-        if (it != inputs.end() && (*it)->name == str) {
-            return std::distance(inputs.begin(), it);
-        } else {
-            return -1; // 未找到
-        }
+    PortNode* findPort(Symbol name) const {
+        auto it = portIndex.find(name);
+        return it != portIndex.end() ? it->second : nullptr;
     }
-    void simulate_all_to_file (std::ofstream& file) {
-        int input_nums = inputs.size();
-        int output_nums = outputs.size();
-        long long pow = std::pow(2, input_nums);
-        std::vector<STATE> inputs_state(input_nums);
-    
-        file << "| Inputs ";
-        for (int i = 0; i < input_nums; i++) {
-            file << "| ";
-        }
-        file << " Outputs ";
-        for (int i = 0; i < output_nums; i++) {
-            file << "| ";
-        }
-        file << "\n";
-        file << "|";
-        for (int i = 0; i < input_nums + output_nums; i++) {
-            file << "---|";
-        }
-        file << "\n";
-        file << "| ";
-        for (int i = 0; i < input_nums; i++) {
-            file << " " << inputs[i]->name << " |";
-        }
-        for (int i = 0; i < output_nums; i++) {
-            file << " " << outputs[i]->name << " |";
+    void addPort(PortNode* port) {
+        ports.push_back(port);
+        portIndex.emplace(port->name, port);
+    }
+    // 按名称把晶体管的三个端接到本模块的端口上, 有未定义的端口时返回false
+    bool connectMos(MosNode* mosNode) {
+        auto drain = findPort(mosNode->drain);
+        auto source = findPort(mosNode->source);
+        auto gate = findPort(mosNode->gate);
+        // 三个端子须为已定义且互不相同的端口(与原先逐端口计数的检查一致)
+        if (drain == nullptr || source == nullptr || gate == nullptr ||
+            drain == source || drain == gate || source == gate) {
+            return false;
         }
-        file << "\n";
-        
-
-        for (long long i = 0; i < pow; i++) {
-            file << "|";
-            // TODO 全部真值
-            for (int j = 0; j < input_nums; j++) {
-                inputs_state[j] = translate((i >> j) & 1);
-                file << " " << retranslate(inputs_state[j]) << " |";
-            }
-            trigger(inputs_state);
-            for (int j = 0; j < output_nums; j++) {
-                file << " " << retranslate(outputs[j]->state) << " |";
+        drain->in.push_back(mosNode);
+        mosNode->_drain = drain;
+        source->out.push_back(mosNode);
+        mosNode->_source = source;
+        gate->out.push_back(mosNode);
+        mosNode->_gate = gate;
+        return true;
+    }
+    void collectPuts() {
+        inputs.clear();
+        outputs.clear();
+        for (auto& p : ports) {
+            if (p->type == INPUT) {
+                inputs.push_back(p);
+            } else if (p->type == OUTPUT) {
+                outputs.push_back(p);
             }
-            file << "\n";
         }
     }
+    template <typename Pred>
+    void removePortsIf(Pred pred) {
+        ports.erase(std::remove_if(ports.begin(), ports.end(), [&](PortNode* port) {
+            if (!pred(port)) return false;
+            auto it = portIndex.find(port->name);
+            if (it != portIndex.end() && it->second == port) portIndex.erase(it);
+            return true;
+        }), ports.end());
+    }
 
-    void simulate_all() {
-        int input_nums = inputs.size();
-        int output_nums = outputs.size();
-        long long pow = std::pow(2, input_nums);
-        std::vector<STATE> inputs_state(input_nums);
-
-        for (long long i = 0; i < pow; i++) {
-            std::cout << "inputs: ";
-            for (int j = 0; j < input_nums; j++) {
-                inputs_state[j] = translate((i >> j) & 1);
-                std::cout << inputs[j]->name << ": " << retranslate(inputs_state[j]) << "\t";
-            }
-            std::cout << "\n";
-            trigger(inputs_state);
-            std::cout << "outputs: ";
-            for (int j = 0; j < output_nums; j++) {
-                std::cout << outputs[j]->name << ": " << retranslate(outputs[j]->state) << "\t";
+    int getInputIndex(const std::string& str) {
+        auto it = std::lower_bound(inputs.begin(), inputs.end(), str, 
+            [](PortNode* node, const std::string& value) {
+                return symName(node->name) < value;
             }
-            std::cout << "\n\n";
+        );
+        if (it != inputs.end() && symName((*it)->name) == str) {
+            return std::distance(inputs.begin(), it);
+        } else {
+            return -1; // 未找到
         }
     }
+    // 穷举全部输入组合的真值表(位并行引擎, 见mos_Sim_Hierarchical.hpp)
+    void simulate_all_to_file(std::ostream& file, unsigned threads = 1);
+    void simulate_all(unsigned threads = 1);
+    const SimNetlist& compiled();
+    const LevelNetlist& levelized();
+    const SimProgram& bytecode();
+    const MacroModel& macroModel();
+    const MacroNetlist& macroNetlist();
 
     void conversation() {
         std::cout << "Start your requiring: (Enter exit)\n";
@@ -215,7 +310,7 @@ struct ModuleNode : public ASTNode
         std::vector<STATE> inputs_state(input_nums);
         while (1) {
             for (int i = 0; i < input_nums; i++) {
-                std::cout << inputs[i]->name << ": ";
+                std::cout << symName(inputs[i]->name) << ": ";
                 char c;
                 std::cin >> c;
                 STATE tmp = translate_cin(c);
@@ -226,14 +321,15 @@ struct ModuleNode : public ASTNode
                 }
                 inputs_state[i] = tmp;
             }
-            trigger(inputs_state);
+            size_t evaluated = trigger(inputs_state);
             std::cout << "outputs: ";
             for (int j = 0; j < outputs.size(); j++) {
-                std::cout << outputs[j]->name << ": " << retranslate(outputs[j]->state) << "\t";
+                std::cout << symName(outputs[j]->name) << ": " << retranslate(outputs[j]->state) << "\t";
             }
+            std::cout << "\n(" << evaluated << " nodes evaluated)";
             while (1) {
                 std::cout << "\n";
-                std::cout << "Exit from module " << name << "? [y/n]\n";
+                std::cout << "Exit from module " << symName(name) << "? [y/n]\n";
                 char c;
                 std::cin >> c;
                 if (c == 'y') return;
@@ -243,47 +339,7 @@ struct ModuleNode : public ASTNode
         }
     }
 
-    void trigger(std::vector<STATE>& inputs_state) {
-        if (inputs_state.size() != inputs.size()) {
-            throw std::runtime_error("inputs size doens't match");
-        }
-        reset();
-        ports[0]->trigger(ONE);
-        ports[1]->trigger(ZERO);
-        for (int i = 0; i < inputs_state.size(); i++) {
-            inputs[i]->trigger(inputs_state[i]);
-        }
-    }
-
-    void reset() {
-        for (int i = 0; i < ports.size(); i++) {
-            ports[i]->state = Z;
-        }
-    }
+    // 按给定输入求各端口的状态(写入port->state), 返回求值的晶体管数
+    // 同一模块的多次调用是增量的: 只重算与上次不同的输入影响到的端口
+    size_t trigger(const std::vector<STATE>& inputs_state);
 };
-
-
-void PortNode::trigger(STATE new_state) {
-    // std::cout << "set port " << name << " as " << retranslate(new_state) << "\n";
-    if (state == X || state == new_state || new_state == Z) {
-        return;
-    } else if (state == Z) {
-        state = new_state;
-    } else {
-        state = X;
-    }
-    for (int i = 0; i < out.size(); i++) {
-        out[i]->trigger();
-    }
-}
-
-void MosNode::trigger() {
-    if (_gate->state == Z) return;
-    if (_gate->state == X) {
-        _drain->trigger(X);
-    } else if (type == PMOS) {
-        if (_gate->state == ZERO) _drain->trigger(_source->state);
-    } else {
-        if (_gate->state == ONE) _drain->trigger(_source->state);
-    }
-}
\ No newline at end of file
@@ -0,0 +1,2611 @@
+#pragma once
+#include "mos_AST_Hierarchical.hpp"
+#include "bdd.hpp"
+#include "mmap_file.hpp"
+#include "json_writer.hpp"
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <iomanip>
+#include <map>
+#include <random>
+#include <thread>
+#include <unordered_set>
+
+// 编译后的开关级网表: 端口和晶体管按下标存放在连续数组中, 供各仿真引擎使用
+// 仿真语义: 端口状态按 Z < 0,1 < X 只增不减(不同的驱动合并为X), 导通的晶体管把源极状态
+// 传到漏极(栅极为X时漏极为X), 结果是这组单调方程的最小不动点
+struct SimNetlist {
+    struct Mos {
+        uint32_t type;
+        uint32_t gate;
+        uint32_t source;
+        uint32_t drain;
+    };
+    size_t portCount = 0;
+    std::vector<Mos> mosfets;
+    // 读取端口(作为栅极或源极)的晶体管, CSR: fanout[fanoutStart[p], fanoutStart[p+1])
+    std::vector<uint32_t> fanoutStart;
+    std::vector<uint32_t> fanout;
+    // 以端口为漏极的晶体管, CSR: drivers[driverStart[p], driverStart[p+1])
+    std::vector<uint32_t> driverStart;
+    std::vector<uint32_t> drivers;
+    std::vector<uint32_t> inputs;
+    std::vector<uint32_t> outputs;
+    long long vcc = -1;
+    long long gnd = -1;
+    // 按信号传播方向排好的晶体管求值顺序(环路中的晶体管排在最后)
+    std::vector<uint32_t> order;
+
+    void compile(const ModuleNode& m) {
+        portCount = m.ports.size();
+        std::unordered_map<const PortNode*, uint32_t> index;
+        for (size_t i = 0; i < m.ports.size(); i++) {
+            index.emplace(m.ports[i], static_cast<uint32_t>(i));
+            if (m.ports[i]->name == SYM_VCC) vcc = static_cast<long long>(i);
+            if (m.ports[i]->name == SYM_GND) gnd = static_cast<long long>(i);
+        }
+        for (auto& p : m.inputs) inputs.push_back(index.at(p));
+        for (auto& p : m.outputs) outputs.push_back(index.at(p));
+        mosfets.reserve(m.mosfets.size());
+        for (auto& mos : m.mosfets) {
+            mosfets.push_back({static_cast<uint32_t>(mos->type), index.at(mos->_gate), index.at(mos->_source), index.at(mos->_drain)});
+        }
+        build();
+    }
+
+    // 端口p的结构依赖: 沿驱动晶体管的栅极和源极向前追溯能到达的全部端口(含p)
+    // 仿真中p的状态只由这些端口决定, 其中的输入即p的支撑集
+    std::vector<uint8_t> fanin(const std::vector<uint32_t>& roots) const {
+        std::vector<uint8_t> seen(portCount, 0);
+        std::vector<uint32_t> stack;
+        for (uint32_t r : roots) {
+            if (!seen[r]) {
+                seen[r] = 1;
+                stack.push_back(r);
+            }
+        }
+        while (!stack.empty()) {
+            uint32_t p = stack.back();
+            stack.pop_back();
+            for (uint32_t k = driverStart[p]; k < driverStart[p + 1]; k++) {
+                const Mos& mos = mosfets[drivers[k]];
+                for (uint32_t q : {mos.gate, mos.source}) {
+                    if (!seen[q]) {
+                        seen[q] = 1;
+                        stack.push_back(q);
+                    }
+                }
+            }
+        }
+        return seen;
+    }
+    // 输出o依赖的输入, 按在inputs中的下标升序
+    std::vector<uint32_t> support(uint32_t o) const {
+        std::vector<uint8_t> seen = fanin({o});
+        std::vector<uint32_t> result;
+        for (uint32_t j = 0; j < inputs.size(); j++) {
+            if (seen[inputs[j]]) result.push_back(j);
+        }
+        return result;
+    }
+    // 只含roots的输出锥的子网表: 端口重新编号, 输入只保留锥内的(保持原顺序), 输出为roots
+    SimNetlist cone(const std::vector<uint32_t>& roots) const {
+        std::vector<uint8_t> seen = fanin(roots);
+        std::vector<uint32_t> index(portCount, 0);
+        SimNetlist c;
+        for (uint32_t p = 0; p < portCount; p++) {
+            if (seen[p]) index[p] = static_cast<uint32_t>(c.portCount++);
+        }
+        if (vcc >= 0 && seen[vcc]) c.vcc = index[vcc];
+        if (gnd >= 0 && seen[gnd]) c.gnd = index[gnd];
+        for (uint32_t p : inputs) {
+            if (seen[p]) c.inputs.push_back(index[p]);
+        }
+        for (uint32_t p : roots) c.outputs.push_back(index[p]);
+        for (auto& mos : mosfets) {
+            if (seen[mos.drain]) c.mosfets.push_back({mos.type, index[mos.gate], index[mos.source], index[mos.drain]});
+        }
+        c.build();
+        return c;
+    }
+
+private:
+    // 由mosfets建立fanout/drivers索引和求值顺序
+    void build() {
+        std::vector<uint32_t> readers(portCount + 1, 0);
+        for (auto& c : mosfets) {
+            readers[c.gate + 1]++;
+            if (c.source != c.gate) readers[c.source + 1]++;
+        }
+        for (size_t p = 0; p < portCount; p++) readers[p + 1] += readers[p];
+        fanoutStart = readers;
+        fanout.resize(readers[portCount]);
+        for (uint32_t i = 0; i < mosfets.size(); i++) {
+            fanout[readers[mosfets[i].gate]++] = i;
+            if (mosfets[i].source != mosfets[i].gate) fanout[readers[mosfets[i].source]++] = i;
+        }
+        driverStart.assign(portCount + 1, 0);
+        for (auto& mos : mosfets) driverStart[mos.drain + 1]++;
+        for (size_t p = 0; p < portCount; p++) driverStart[p + 1] += driverStart[p];
+        drivers.resize(mosfets.size());
+        std::vector<uint32_t> next(driverStart.begin(), driverStart.end() - 1);
+        for (uint32_t i = 0; i < mosfets.size(); i++) drivers[next[mosfets[i].drain]++] = i;
+        levelize();
+    }
+
+    // 端口的所有驱动晶体管都已排序后, 读它的晶体管才可能就绪
+    void levelize() {
+        std::vector<uint32_t> drivers(portCount, 0);
+        for (auto& mos : mosfets) drivers[mos.drain]++;
+        std::vector<uint8_t> waiting(mosfets.size(), 0), placed(mosfets.size(), 0);
+        std::vector<uint32_t> ready;
+        for (uint32_t i = 0; i < mosfets.size(); i++) {
+            waiting[i] = (drivers[mosfets[i].gate] > 0) + (mosfets[i].source != mosfets[i].gate && drivers[mosfets[i].source] > 0);
+            if (waiting[i] == 0) ready.push_back(i);
+        }
+        order.clear();
+        order.reserve(mosfets.size());
+        size_t next = 0;
+        while (order.size() < mosfets.size()) {
+            if (next == ready.size()) {
+                // 环路: 取第一个未排序的晶体管打破
+                for (uint32_t i = 0; i < mosfets.size(); i++) {
+                    if (!placed[i]) {
+                        ready.push_back(i);
+                        break;
+                    }
+                }
+            }
+            uint32_t m = ready[next++];
+            if (placed[m]) continue;
+            placed[m] = 1;
+            order.push_back(m);
+            uint32_t d = mosfets[m].drain;
+            if (--drivers[d] == 0) {
+                for (uint32_t k = fanoutStart[d]; k < fanoutStart[d + 1]; k++) {
+                    uint32_t f = fanout[k];
+                    if (!placed[f] && waiting[f] > 0 && --waiting[f] == 0) ready.push_back(f);
+                }
+            }
+        }
+    }
+};
+
+// 64位并行仿真: 每个端口的状态用两个位平面表示(Z=00, 0=10, 1=01, X=11), 合并即按位或
+// 每次求值SIM_WORDS个字(256组输入), 内层按字循环, 开启AVX2时编译器可向量化
+const int SIM_WORDS = 4;
+const uint64_t SIM_BLOCK = 64 * SIM_WORDS;
+
+// 位平面的初值: 全部为Z, VCC/GND为常量, 输入j在第k个字中可能为0/1的组为zeros(j, k)/ones(j, k)
+template <class Zeros, class Ones>
+inline void seedPlanes(const SimNetlist& net, std::vector<uint64_t>& zero, std::vector<uint64_t>& one, Zeros zeros, Ones ones) {
+    std::fill(zero.begin(), zero.end(), 0);
+    std::fill(one.begin(), one.end(), 0);
+    if (net.vcc >= 0) std::fill_n(one.begin() + net.vcc * SIM_WORDS, SIM_WORDS, ~0ull);
+    if (net.gnd >= 0) std::fill_n(zero.begin() + net.gnd * SIM_WORDS, SIM_WORDS, ~0ull);
+    for (size_t j = 0; j < net.inputs.size(); j++) {
+        uint64_t* z = &zero[net.inputs[j] * SIM_WORDS];
+        uint64_t* o = &one[net.inputs[j] * SIM_WORDS];
+        for (int k = 0; k < SIM_WORDS; k++) {
+            o[k] |= ones(j, k);
+            z[k] |= zeros(j, k);
+        }
+    }
+}
+// 输入只取0/1: 输入j在第k个字中各组的取值为bits(j, k)
+template <class Bits>
+inline void seedInputs(const SimNetlist& net, std::vector<uint64_t>& zero, std::vector<uint64_t>& one, Bits bits) {
+    seedPlanes(net, zero, one, [&](size_t j, int k) { return ~bits(j, k); }, bits);
+}
+// 输入按行号取位: 第base+i组输入中输入j取 ((base+i)>>j)&1
+inline void seedBlock(const SimNetlist& net, std::vector<uint64_t>& zero, std::vector<uint64_t>& one, uint64_t base) {
+    static const uint64_t lanePattern[6] = {0xAAAAAAAAAAAAAAAAull, 0xCCCCCCCCCCCCCCCCull, 0xF0F0F0F0F0F0F0F0ull,
+                                            0xFF00FF00FF00FF00ull, 0xFFFF0000FFFF0000ull, 0xFFFFFFFF00000000ull};
+    seedInputs(net, zero, one, [&](size_t j, int k) {
+        uint64_t row = base + 64 * k;
+        return j < 6 ? lanePattern[j] : (j < 64 && ((row >> j) & 1) ? ~0ull : 0);
+    });
+}
+inline STATE laneState(const std::vector<uint64_t>& zero, const std::vector<uint64_t>& one, uint32_t p, uint64_t lane) {
+    size_t w = p * SIM_WORDS + lane / 64;
+    int bit = lane % 64;
+    bool z = (zero[w] >> bit) & 1, o = (one[w] >> bit) & 1;
+    return z ? (o ? X : ZERO) : (o ? ONE : Z);
+}
+
+class BitSim {
+public:
+    explicit BitSim(const SimNetlist& net)
+        : net(net), zero(net.portCount * SIM_WORDS), one(net.portCount * SIM_WORDS), dirty(net.mosfets.size()) {}
+
+    // 仿真第 base 到 base+SIM_BLOCK-1 行(第i行中输入j取 (i>>j)&1), base为SIM_BLOCK的倍数
+    void runBlock(uint64_t base) {
+        seedBlock(net, zero, one, base);
+        settle();
+    }
+    // 第lane组输入下端口p的状态
+    STATE state(uint32_t p, uint64_t lane) const { return laneState(zero, one, p, lane); }
+
+private:
+    // 按求值顺序扫描, 只重新计算输入发生变化的晶体管, 直到没有变化
+    void settle() {
+        std::fill(dirty.begin(), dirty.end(), 1);
+        size_t pending = dirty.size();
+        while (pending > 0) {
+            for (uint32_t m : net.order) {
+                if (!dirty[m]) continue;
+                dirty[m] = 0;
+                pending--;
+                if (eval(net.mosfets[m])) {
+                    uint32_t d = net.mosfets[m].drain;
+                    for (uint32_t k = net.fanoutStart[d]; k < net.fanoutStart[d + 1]; k++) {
+                        uint32_t f = net.fanout[k];
+                        if (!dirty[f]) {
+                            dirty[f] = 1;
+                            pending++;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    // NMOS: 栅极为1时导通; PMOS: 栅极为0时导通; 栅极为X时漏极为X
+    bool eval(const SimNetlist::Mos& mos) {
+        const uint64_t* g0 = &zero[mos.gate * SIM_WORDS];
+        const uint64_t* g1 = &one[mos.gate * SIM_WORDS];
+        const uint64_t* s0 = &zero[mos.source * SIM_WORDS];
+        const uint64_t* s1 = &one[mos.source * SIM_WORDS];
+        uint64_t* d0 = &zero[mos.drain * SIM_WORDS];
+        uint64_t* d1 = &one[mos.drain * SIM_WORDS];
+        uint64_t changed = 0;
+        for (int k = 0; k < SIM_WORDS; k++) {
+            uint64_t on = mos.type == PMOS ? g0[k] : g1[k];
+            uint64_t off = mos.type == PMOS ? g1[k] : g0[k];
+            uint64_t n0 = d0[k] | (on & (s0[k] | off));
+            uint64_t n1 = d1[k] | (on & (s1[k] | off));
+            changed |= (n0 ^ d0[k]) | (n1 ^ d1[k]);
+            d0[k] = n0;
+            d1[k] = n1;
+        }
+        return changed != 0;
+    }
+
+    const SimNetlist& net;
+    std::vector<uint64_t> zero;  // 可能为0的位平面
+    std::vector<uint64_t> one;   // 可能为1的位平面
+    std::vector<uint8_t> dirty;
+};
+
+// 事件驱动的单组输入仿真: 状态改变的端口进入FIFO队列(已在队列中的不重复入队),
+// 出队时求值读取它的晶体管. 每个端口的状态最多改变两次(Z->0/1->X), 入队次数因此有上界
+class EventSim {
+public:
+    explicit EventSim(const SimNetlist& net)
+        : net(net), states(net.portCount, Z), queued(net.portCount, 0), mark(net.portCount, 0),
+          inputIndex(net.portCount, -1) {
+        for (size_t j = 0; j < net.inputs.size(); j++) inputIndex[net.inputs[j]] = static_cast<int>(j);
+    }
+
+    // 从全部为Z开始求给定输入下的状态, 返回求值的晶体管数
+    size_t run(const std::vector<STATE>& in) {
+        std::fill(states.begin(), states.end(), Z);
+        evaluated = 0;
+        last = in;
+        settled = true;
+        if (net.vcc >= 0) drive(net.vcc, ONE);
+        if (net.gnd >= 0) drive(net.gnd, ZERO);
+        for (size_t j = 0; j < net.inputs.size(); j++) {
+            drive(net.inputs[j], in[j]);
+        }
+        propagate();
+        cone.clear();
+        return evaluated;
+    }
+    // 在上次结果的基础上只重算改变的输入的传递扇出: 扇出内的端口清为Z, 由激励和驱动它们的
+    // 晶体管重新传播(扇出外的端口不受影响, 状态不变), 结果与run()相同. 返回求值的晶体管数
+    size_t update(const std::vector<STATE>& in) {
+        if (!settled) return run(in);
+        evaluated = 0;
+        cone.clear();
+        if (++epoch == 0) {
+            std::fill(mark.begin(), mark.end(), 0);
+            epoch = 1;
+        }
+        for (size_t j = 0; j < net.inputs.size(); j++) {
+            if (in[j] != last[j]) addToCone(net.inputs[j]);
+        }
+        last = in;
+        for (size_t head = 0; head < cone.size(); head++) {
+            uint32_t p = cone[head];
+            for (uint32_t k = net.fanoutStart[p]; k < net.fanoutStart[p + 1]; k++) {
+                addToCone(net.mosfets[net.fanout[k]].drain);
+            }
+        }
+        for (uint32_t p : cone) states[p] = Z;
+        for (uint32_t p : cone) {
+            if (p == net.vcc) drive(p, ONE);
+            if (p == net.gnd) drive(p, ZERO);
+            if (inputIndex[p] >= 0) drive(p, in[inputIndex[p]]);
+            for (uint32_t k = net.driverStart[p]; k < net.driverStart[p + 1]; k++) {
+                eval(net.mosfets[net.drivers[k]]);
+            }
+        }
+        propagate();
+        return evaluated;
+    }
+    STATE state(uint32_t p) const { return states[p]; }
+    // 上次update()重算过的端口(run()之后为空)
+    const std::vector<uint32_t>& changed() const { return cone; }
+
+private:
+    static STATE merge(STATE old, STATE s) {
+        if (s == Z || old == s || old == X) return old;
+        return old == Z ? s : X;
+    }
+    void drive(uint32_t p, STATE s) {
+        STATE n = merge(states[p], s);
+        if (n == states[p]) return;
+        states[p] = n;
+        if (!queued[p]) {
+            queued[p] = 1;
+            queue.push_back(p);
+        }
+    }
+    void propagate() {
+        size_t limit = 2 * net.portCount;
+        for (size_t head = 0; head < queue.size(); head++) {
+            if (head >= limit) {
+                throw std::runtime_error("Error:仿真未收敛");
+            }
+            uint32_t p = queue[head];
+            queued[p] = 0;
+            for (uint32_t k = net.fanoutStart[p]; k < net.fanoutStart[p + 1]; k++) {
+                eval(net.mosfets[net.fanout[k]]);
+            }
+        }
+        queue.clear();
+    }
+    void eval(const SimNetlist::Mos& mos) {
+        evaluated++;
+        STATE g = states[mos.gate];
+        if (g == Z) return;
+        if (g == X) {
+            drive(mos.drain, X);
+        } else if (g == (mos.type == PMOS ? ZERO : ONE)) {
+            drive(mos.drain, states[mos.source]);
+        }
+    }
+
+    void addToCone(uint32_t p) {
+        if (mark[p] == epoch) return;
+        mark[p] = epoch;
+        cone.push_back(p);
+    }
+
+    const SimNetlist& net;
+    std::vector<STATE> states;
+    std::vector<uint8_t> queued;
+    std::vector<uint32_t> queue;
+    size_t evaluated = 0;
+    // 增量更新: 上次的输入, 扇出标记(按epoch区分, 不必每次清零)和本次重算的端口
+    bool settled = false;
+    std::vector<STATE> last;
+    std::vector<uint32_t> mark;
+    uint32_t epoch = 0;
+    std::vector<uint32_t> cone;
+    std::vector<int> inputIndex;
+};
+
+// 沟道连通分量(CCC): 经源/漏极相连的端口和晶体管归为一组, VCC/GND和输入作为边界, 不参与合并
+struct ChannelGroups {
+    std::vector<char> rail;
+    std::vector<int> owner;  // 端口所属的组, 边界端口和不接沟道的端口为-1
+    std::vector<std::vector<uint32_t>> ports;
+    std::vector<std::vector<uint32_t>> mosfets;
+    bool railDriven = false;  // 有晶体管以边界端口为漏极(这些晶体管不属于任何组)
+
+    explicit ChannelGroups(const SimNetlist& net) : ChannelGroups(net, net.mosfets, {}) {}
+    // 只对给定的晶体管分组(下标即mosfets中的位置), boundary中的端口同样作为边界
+    ChannelGroups(const SimNetlist& net, const std::vector<SimNetlist::Mos>& mos, const std::vector<uint32_t>& boundary)
+        : rail(net.portCount, 0), owner(net.portCount, -1) {
+        size_t n = net.portCount;
+        if (net.vcc >= 0) rail[net.vcc] = 1;
+        if (net.gnd >= 0) rail[net.gnd] = 1;
+        for (uint32_t p : net.inputs) rail[p] = 1;
+        for (uint32_t p : boundary) rail[p] = 1;
+        std::vector<uint32_t> parent(n);
+        for (uint32_t p = 0; p < n; p++) parent[p] = p;
+        auto find = [&](uint32_t p) {
+            while (parent[p] != p) p = parent[p] = parent[parent[p]];
+            return p;
+        };
+        for (auto& t : mos) {
+            if (rail[t.drain]) railDriven = true;
+            else if (!rail[t.source]) parent[find(t.source)] = find(t.drain);
+        }
+        std::vector<int> group(n, -1);
+        for (uint32_t m = 0; m < mos.size(); m++) {
+            if (rail[mos[m].drain]) continue;
+            uint32_t r = find(mos[m].drain);
+            if (group[r] < 0) {
+                group[r] = static_cast<int>(ports.size());
+                ports.emplace_back();
+                mosfets.emplace_back();
+            }
+            mosfets[group[r]].push_back(m);
+        }
+        for (uint32_t p = 0; p < n; p++) {
+            if (!rail[p] && group[find(p)] >= 0) {
+                owner[p] = group[find(p)];
+                ports[owner[p]].push_back(p);
+            }
+        }
+    }
+};
+
+// 按沟道连通分量编译的网表: 分量按栅极依赖排成拓扑序, 每个分量的内部端口状态预先算成以其输入为下标的查找表.
+// STATE的取值0..3即为表下标中的2位; 有反馈、输入过多或边界端口被驱动时ok为false, 退回EventSim
+struct LevelNetlist {
+    static const int MAX_INPUTS = 8;
+    struct Component {
+        uint32_t firstInput, inputCount;  // inputs[firstInput, +inputCount)
+        uint32_t firstPort, portCount;    // ports[firstPort, +portCount)
+        uint64_t lut;                     // 查找表起始位置: 第e项在luts[lut + e*portCount, +portCount)
+    };
+    bool ok = false;
+    std::string reason;
+    std::vector<Component> components;  // 拓扑序
+    std::vector<uint32_t> inputs;
+    std::vector<uint32_t> ports;
+    std::vector<uint8_t> luts;
+    // 以端口为输入的分量(拓扑序下标), CSR
+    std::vector<uint32_t> readerStart;
+    std::vector<uint32_t> readers;
+
+    bool compile(const SimNetlist& net) { return build(net, net.mosfets, {}); }
+    // 按宏模型网表编译: 宏单元各为一个分量(同一模型的实例共用查找表), 其输出端口与输入一样作为其余晶体管的边界
+    bool compile(const SimNetlist& net, const MacroNetlist& macro);
+
+private:
+    // 已有查找表的单元(宏单元): 表在luts[lut]起, 第e项为各输出的状态
+    struct Cell {
+        std::vector<uint32_t> inputs, outputs;
+        uint64_t lut;
+    };
+    bool build(const SimNetlist& net, const std::vector<SimNetlist::Mos>& mosfets, const std::vector<Cell>& cells) {
+        size_t n = net.portCount;
+        // 单元的输出只能由该单元驱动
+        std::vector<int> cellOwner(n, -1);
+        std::vector<uint32_t> boundary;
+        for (size_t i = 0; i < cells.size(); i++) {
+            for (uint32_t p : cells[i].outputs) {
+                bool input = std::find(net.inputs.begin(), net.inputs.end(), p) != net.inputs.end();
+                if (p == net.vcc || p == net.gnd || input || cellOwner[p] >= 0) return fail("宏单元输出被其他单元驱动");
+                cellOwner[p] = static_cast<int>(i);
+                boundary.push_back(p);
+            }
+        }
+        ChannelGroups groups(net, mosfets, boundary);
+        if (groups.railDriven) return fail("边界端口被晶体管驱动");
+        const std::vector<char>& rail = groups.rail;
+        const auto& groupPorts = groups.ports;
+        const auto& groupMos = groups.mosfets;
+        // 分量的编号: 先是各沟道分量, 接着是各单元
+        size_t g = groupPorts.size();
+        size_t total = g + cells.size();
+        auto ownerOf = [&](uint32_t p) -> long long {
+            if (groups.owner[p] >= 0) return groups.owner[p];
+            return cellOwner[p] >= 0 ? static_cast<long long>(g + cellOwner[p]) : -1;
+        };
+        // 分量的输入: 栅极和作为源极的边界端口(VCC/GND为常量, 不计入)
+        std::vector<std::vector<uint32_t>> groupInputs(g);
+        std::vector<std::vector<uint32_t>> dependents(total);
+        std::vector<uint32_t> pending(total, 0);
+        auto depend = [&](size_t c, uint32_t p) {
+            long long o = ownerOf(p);
+            if (o < 0) return true;
+            if (o == static_cast<long long>(c)) return false;
+            dependents[o].push_back(static_cast<uint32_t>(c));
+            pending[c]++;
+            return true;
+        };
+        for (size_t c = 0; c < g; c++) {
+            auto add = [&](uint32_t p) {
+                if (p == net.vcc || p == net.gnd) return;
+                if (std::find(groupInputs[c].begin(), groupInputs[c].end(), p) != groupInputs[c].end()) return;
+                groupInputs[c].push_back(p);
+                depend(c, p);
+            };
+            for (uint32_t m : groupMos[c]) {
+                const SimNetlist::Mos& mos = mosfets[m];
+                if (groups.owner[mos.gate] == static_cast<int>(c)) return fail("分量内部有反馈");
+                add(mos.gate);
+                if (rail[mos.source]) add(mos.source);
+            }
+            if (groupInputs[c].size() > MAX_INPUTS) return fail("分量输入过多");
+        }
+        // 单元的输入按查找表的下标顺序, 可以重复或为VCC/GND
+        for (size_t i = 0; i < cells.size(); i++) {
+            for (uint32_t p : cells[i].inputs) {
+                if (!depend(g + i, p)) return fail("分量内部有反馈");
+            }
+        }
+        std::vector<uint32_t> order;
+        for (uint32_t c = 0; c < total; c++) {
+            if (pending[c] == 0) order.push_back(c);
+        }
+        for (size_t head = 0; head < order.size(); head++) {
+            for (uint32_t d : dependents[order[head]]) {
+                if (--pending[d] == 0) order.push_back(d);
+            }
+        }
+        if (order.size() < total) return fail("分量之间有反馈");
+
+        std::vector<uint32_t> count(n + 1, 0);
+        for (uint32_t c : order) {
+            const auto& in = c < g ? groupInputs[c] : cells[c - g].inputs;
+            const auto& out = c < g ? groupPorts[c] : cells[c - g].outputs;
+            Component comp{static_cast<uint32_t>(inputs.size()), static_cast<uint32_t>(in.size()),
+                           static_cast<uint32_t>(ports.size()), static_cast<uint32_t>(out.size()),
+                           c < g ? luts.size() : cells[c - g].lut};
+            inputs.insert(inputs.end(), in.begin(), in.end());
+            ports.insert(ports.end(), out.begin(), out.end());
+            for (uint32_t p : in) count[p + 1]++;
+            if (c < g) buildTable(net, mosfets, comp, groupMos[c]);
+            components.push_back(comp);
+        }
+        for (size_t p = 0; p < n; p++) count[p + 1] += count[p];
+        readerStart = count;
+        readers.resize(inputs.size());
+        for (uint32_t i = 0; i < components.size(); i++) {
+            const Component& comp = components[i];
+            for (uint32_t k = 0; k < comp.inputCount; k++) readers[count[inputs[comp.firstInput + k]]++] = i;
+        }
+        ok = true;
+        return true;
+    }
+    bool fail(const char* why) {
+        reason = why;
+        ok = false;
+        return false;
+    }
+    // 对每种输入组合在分量内部求最小不动点
+    void buildTable(const SimNetlist& net, const std::vector<SimNetlist::Mos>& mosfets, const Component& comp,
+                    const std::vector<uint32_t>& mos) {
+        std::unordered_map<uint32_t, uint32_t> local;
+        for (uint32_t k = 0; k < comp.portCount; k++) local.emplace(ports[comp.firstPort + k], k);
+        std::unordered_map<uint32_t, uint32_t> input;
+        for (uint32_t k = 0; k < comp.inputCount; k++) input.emplace(inputs[comp.firstInput + k], k);
+        uint64_t entries = 1ull << (2 * comp.inputCount);
+        luts.resize(luts.size() + entries * comp.portCount);
+        std::vector<STATE> states(comp.portCount);
+        for (uint64_t e = 0; e < entries; e++) {
+            std::fill(states.begin(), states.end(), Z);
+            auto value = [&](uint32_t p) {
+                if (p == net.vcc) return ONE;
+                if (p == net.gnd) return ZERO;
+                auto it = local.find(p);
+                if (it != local.end()) return states[it->second];
+                return static_cast<STATE>((e >> (2 * input.at(p))) & 3);
+            };
+            for (bool changed = true; changed;) {
+                changed = false;
+                for (uint32_t m : mos) {
+                    const SimNetlist::Mos& t = mosfets[m];
+                    STATE gate = value(t.gate), drive;
+                    if (gate == Z) continue;
+                    if (gate == X) drive = X;
+                    else if (gate == (t.type == PMOS ? ZERO : ONE)) drive = value(t.source);
+                    else continue;
+                    STATE& d = states[local.at(t.drain)];
+                    STATE n = drive == Z || d == drive || d == X ? d : (d == Z ? drive : X);
+                    if (n != d) {
+                        d = n;
+                        changed = true;
+                    }
+                }
+            }
+            for (uint32_t k = 0; k < comp.portCount; k++) luts[comp.lut + e * comp.portCount + k] = states[k];
+        }
+    }
+};
+
+// 按拓扑序逐个分量查表, 接口与EventSim相同; update()只重算输入改变过的分量
+class LevelSim {
+public:
+    LevelSim(const SimNetlist& net, const LevelNetlist& level)
+        : net(net), level(level), states(net.portCount, Z), dirty(level.components.size(), 0) {}
+
+    size_t run(const std::vector<STATE>& in) {
+        std::fill(states.begin(), states.end(), Z);
+        if (net.vcc >= 0) states[net.vcc] = ONE;
+        if (net.gnd >= 0) states[net.gnd] = ZERO;
+        for (size_t j = 0; j < net.inputs.size(); j++) states[net.inputs[j]] = in[j];
+        std::fill(dirty.begin(), dirty.end(), 1);
+        settled = true;
+        sweep();
+        cone.clear();
+        return level.components.size();
+    }
+    size_t update(const std::vector<STATE>& in) {
+        if (!settled) return run(in);
+        cone.clear();
+        for (size_t j = 0; j < net.inputs.size(); j++) {
+            if (in[j] != states[net.inputs[j]]) set(net.inputs[j], in[j]);
+        }
+        return sweep();
+    }
+    STATE state(uint32_t p) const { return states[p]; }
+    const std::vector<uint32_t>& changed() const { return cone; }
+
+private:
+    void set(uint32_t p, STATE s) {
+        states[p] = s;
+        cone.push_back(p);
+        for (uint32_t k = level.readerStart[p]; k < level.readerStart[p + 1]; k++) dirty[level.readers[k]] = 1;
+    }
+    // 读取的分量总在拓扑序的后面, 一遍扫描即可
+    size_t sweep() {
+        size_t evaluated = 0;
+        for (size_t c = 0; c < level.components.size(); c++) {
+            if (!dirty[c]) continue;
+            dirty[c] = 0;
+            evaluated++;
+            const LevelNetlist::Component& comp = level.components[c];
+            uint64_t e = 0;
+            for (uint32_t k = 0; k < comp.inputCount; k++) {
+                e |= uint64_t(states[level.inputs[comp.firstInput + k]]) << (2 * k);
+            }
+            const uint8_t* row = &level.luts[comp.lut + e * comp.portCount];
+            for (uint32_t k = 0; k < comp.portCount; k++) {
+                uint32_t p = level.ports[comp.firstPort + k];
+                if (states[p] != row[k]) set(p, static_cast<STATE>(row[k]));
+            }
+        }
+        return evaluated;
+    }
+
+    const SimNetlist& net;
+    const LevelNetlist& level;
+    std::vector<STATE> states;
+    std::vector<uint8_t> dirty;
+    bool settled = false;
+    std::vector<uint32_t> cone;
+};
+
+// 静态CMOS门识别: 分量的下拉网络(NMOS, 从GND出发)和上拉网络(PMOS, 从VCC出发)都能按串联(与)/并联(或)
+// 化简为从电源到输出y的一条边, 且两者在0/1输入下互补时, 分量即为门 y = !pd(inputs).
+// 沟道只从源极传到漏极, 所以化简时边有方向. 除y外的内部端口不能被栅极读取, 也不能是模块输出
+struct CmosGate {
+    static constexpr uint32_t AND = 0x80000000u;
+    static constexpr uint32_t OR = 0x80000001u;
+    static constexpr size_t MAX_MOSFETS = 32;
+    static constexpr size_t MAX_INPUTS = 8;
+    uint32_t output;
+    std::vector<uint32_t> inputs;    // 端口下标
+    std::vector<uint32_t> pulldown;  // 下拉网络导通条件的后缀表达式: 叶子为inputs的下标, 运算为AND/OR
+    std::vector<uint32_t> nodes;     // 分量的全部端口, 按源极到漏极的顺序(y在最后)
+    size_t mosCount;
+    std::string kind;  // inv, nandN, norN, aoi, oai
+
+    // 后缀表达式在0/1输入a下的值, invert为真时叶子取反(上拉网络: PMOS在栅极为0时导通)
+    static bool evaluate(const std::vector<uint32_t>& expr, uint64_t a, bool invert) {
+        std::vector<char> stack;
+        for (uint32_t t : expr) {
+            if (t == AND || t == OR) {
+                char r = stack.back();
+                stack.pop_back();
+                stack.back() = t == AND ? (stack.back() && r) : (stack.back() || r);
+            } else {
+                stack.push_back(static_cast<char>(((a >> t) & 1) != invert));
+            }
+        }
+        return stack.back();
+    }
+};
+
+inline std::vector<CmosGate> recognizeGates(const SimNetlist& net, const ChannelGroups& groups) {
+    struct Edge {
+        uint32_t from, to;
+        std::vector<uint32_t> expr;
+    };
+    // 反复合并并联边(或)和串联边(与), 最后应只剩从rail到y的一条边
+    auto reduce = [](std::vector<Edge> edges, uint32_t rail, uint32_t y, std::vector<uint32_t>& expr) {
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (size_t i = 0; i < edges.size(); i++) {
+                for (size_t j = i + 1; j < edges.size(); j++) {
+                    if (edges[i].from != edges[j].from || edges[i].to != edges[j].to) continue;
+                    edges[i].expr.insert(edges[i].expr.end(), edges[j].expr.begin(), edges[j].expr.end());
+                    edges[i].expr.push_back(CmosGate::OR);
+                    edges.erase(edges.begin() + j--);
+                    changed = true;
+                }
+            }
+            for (size_t i = 0; i < edges.size() && !changed; i++) {
+                uint32_t v = edges[i].to;
+                if (v == y || v == rail) continue;
+                int in = 0, out = 0;
+                size_t next = 0;
+                for (size_t j = 0; j < edges.size(); j++) {
+                    if (edges[j].to == v) in++;
+                    if (edges[j].from == v) {
+                        out++;
+                        next = j;
+                    }
+                }
+                if (in != 1 || out != 1 || next == i) continue;
+                edges[i].expr.insert(edges[i].expr.end(), edges[next].expr.begin(), edges[next].expr.end());
+                edges[i].expr.push_back(CmosGate::AND);
+                edges[i].to = edges[next].to;
+                edges.erase(edges.begin() + next);
+                changed = true;
+            }
+        }
+        if (edges.size() != 1 || edges[0].from != rail || edges[0].to != y) return false;
+        expr = edges[0].expr;
+        return true;
+    };
+
+    std::vector<CmosGate> gates;
+    if (net.vcc < 0 || net.gnd < 0) return gates;
+    uint32_t vcc = static_cast<uint32_t>(net.vcc), gnd = static_cast<uint32_t>(net.gnd);
+    std::vector<char> read(net.portCount, 0);
+    for (auto& mos : net.mosfets) read[mos.gate] = 1;
+    for (uint32_t p : net.outputs) read[p] = 1;
+    for (size_t c = 0; c < groups.ports.size(); c++) {
+        const auto& ports = groups.ports[c];
+        const auto& mosfets = groups.mosfets[c];
+        if (mosfets.size() < 2 || mosfets.size() > CmosGate::MAX_MOSFETS) continue;
+        CmosGate gate;
+        gate.mosCount = mosfets.size();
+        long long y = -1;
+        bool ok = true;
+        for (uint32_t p : ports) {
+            if (!read[p]) continue;
+            if (y >= 0) ok = false;
+            y = p;
+        }
+        if (!ok || y < 0) continue;
+        gate.output = static_cast<uint32_t>(y);
+        std::vector<Edge> up, down;
+        std::unordered_map<uint32_t, int> network;  // 内部端口属于哪个网络: 1下拉, 2上拉
+        for (uint32_t m : mosfets) {
+            const SimNetlist::Mos& mos = net.mosfets[m];
+            uint32_t rail = mos.type == PMOS ? vcc : gnd;
+            int side = mos.type == PMOS ? 2 : 1;
+            if (groups.owner[mos.gate] >= 0 && groups.owner[mos.gate] == static_cast<int>(c)) ok = false;
+            if (mos.gate == vcc || mos.gate == gnd) ok = false;
+            if (groups.rail[mos.source] && mos.source != rail) ok = false;
+            if (!ok) break;
+            for (uint32_t p : {mos.source, mos.drain}) {
+                if (p == rail || p == gate.output) continue;
+                if (network[p] != 0 && network[p] != side) ok = false;
+                network[p] = side;
+            }
+            auto it = std::find(gate.inputs.begin(), gate.inputs.end(), mos.gate);
+            uint32_t leaf = static_cast<uint32_t>(it - gate.inputs.begin());
+            if (it == gate.inputs.end()) gate.inputs.push_back(mos.gate);
+            (mos.type == PMOS ? up : down).push_back({mos.source, mos.drain, {leaf}});
+        }
+        if (!ok || gate.inputs.size() > CmosGate::MAX_INPUTS) continue;
+        std::vector<uint32_t> pullup;
+        if (!reduce(down, gnd, gate.output, gate.pulldown) || !reduce(up, vcc, gate.output, pullup)) continue;
+        for (uint64_t a = 0; a < (1ull << gate.inputs.size()) && ok; a++) {
+            ok = CmosGate::evaluate(gate.pulldown, a, false) != CmosGate::evaluate(pullup, a, true);
+        }
+        if (!ok) continue;
+        // 内部端口按沟道方向排序(串并联网络无环)
+        std::unordered_map<uint32_t, int> pending;
+        for (uint32_t p : ports) pending[p] = 0;
+        for (uint32_t m : mosfets) {
+            if (pending.count(net.mosfets[m].source)) pending[net.mosfets[m].drain]++;
+        }
+        for (uint32_t p : ports) {
+            if (pending[p] == 0) gate.nodes.push_back(p);
+        }
+        for (size_t head = 0; head < gate.nodes.size(); head++) {
+            for (uint32_t m : mosfets) {
+                if (net.mosfets[m].source == gate.nodes[head] && --pending[net.mosfets[m].drain] == 0) {
+                    gate.nodes.push_back(net.mosfets[m].drain);
+                }
+            }
+        }
+        if (gate.nodes.size() != ports.size()) continue;
+        bool allAnd = true, allOr = true;
+        for (uint32_t t : gate.pulldown) {
+            if (t == CmosGate::AND) allOr = false;
+            if (t == CmosGate::OR) allAnd = false;
+        }
+        size_t k = gate.inputs.size();
+        if (gate.pulldown.size() == 1) gate.kind = "inv";
+        else if (allAnd && gate.pulldown.size() == 2 * k - 1) gate.kind = "nand" + std::to_string(k);
+        else if (allOr && gate.pulldown.size() == 2 * k - 1) gate.kind = "nor" + std::to_string(k);
+        else gate.kind = gate.pulldown.back() == CmosGate::OR ? "aoi" : "oai";
+        gates.push_back(std::move(gate));
+    }
+    return gates;
+}
+
+// 字节码: 把模块编译成按依赖顺序排列的指令, 寄存器即端口(两个位平面, 每次SIM_BLOCK组输入).
+// 端口按强连通分量的拓扑序求值, 每个被驱动的端口一组指令:
+//   RESOLVE d; NDRIVE/PDRIVE s g ...; STORE d   由上拉/下拉网络中各晶体管的条件驱动合并出d
+//   INV d g                                      单管上拉(VCC)加单管下拉(GND)的反相器
+//   GATE y skip k in... len expr...              识别出的CMOS门: 输入全为0/1时按位计算y = !pd并跳过
+//                                                后面skip个字(该门的开关级指令), 否则执行开关级指令
+//   NAND/NOR y skip k in...                      与非/或非门, 同GATE但不用表达式
+// 有环的分量(锁存器、双向沟道)包在 LOOP ... REPEAT 中, 直到没有端口改变
+enum SimOp : uint32_t {
+    OP_RESOLVE, OP_NDRIVE, OP_PDRIVE, OP_STORE, OP_INV, OP_GATE, OP_NAND, OP_NOR, OP_LOOP, OP_REPEAT, OP_HALT
+};
+
+struct SimProgram {
+    std::vector<uint32_t> code;  // 操作数为寄存器偏移(端口下标*SIM_WORDS)
+    size_t loops = 0;
+    std::vector<CmosGate> gates;
+
+    void compile(const SimNetlist& net) {
+        size_t n = net.portCount;
+        // 门的内部端口只在门的指令中求值
+        gates = recognizeGates(net, ChannelGroups(net));
+        gateOf.assign(n, -1);
+        absorbed.assign(n, 0);
+        for (size_t g = 0; g < gates.size(); g++) {
+            for (uint32_t p : gates[g].nodes) absorbed[p] = 1;
+            absorbed[gates[g].output] = 0;
+            gateOf[gates[g].output] = static_cast<int>(g);
+        }
+        // 迭代的Tarjan算法: 依赖(栅极/源极)所在的分量先于依赖它的端口输出
+        std::vector<int> index(n, -1), low(n, 0);
+        std::vector<char> onStack(n, 0);
+        std::vector<uint32_t> stack;
+        std::vector<std::pair<uint32_t, uint32_t>> calls;  // (端口, 已访问的依赖数)
+        int counter = 0;
+        auto dependency = [&](uint32_t p, uint32_t k) {
+            const SimNetlist::Mos& mos = net.mosfets[net.drivers[net.driverStart[p] + k / 2]];
+            return k % 2 == 0 ? mos.gate : mos.source;
+        };
+        for (uint32_t root = 0; root < n; root++) {
+            if (index[root] >= 0 || !driven(net, root)) continue;
+            calls.push_back({root, 0});
+            while (!calls.empty()) {
+                uint32_t p = calls.back().first;
+                uint32_t& k = calls.back().second;
+                if (k == 0 && index[p] < 0) {
+                    index[p] = low[p] = counter++;
+                    stack.push_back(p);
+                    onStack[p] = 1;
+                }
+                uint32_t deps = 2 * (net.driverStart[p + 1] - net.driverStart[p]);
+                if (k < deps) {
+                    uint32_t q = dependency(p, k++);
+                    if (!driven(net, q)) continue;
+                    if (index[q] < 0) {
+                        calls.push_back({q, 0});
+                    } else if (onStack[q]) {
+                        low[p] = std::min(low[p], index[q]);
+                    }
+                    continue;
+                }
+                calls.pop_back();
+                if (!calls.empty()) {
+                    uint32_t parent = calls.back().first;
+                    low[parent] = std::min(low[parent], low[p]);
+                }
+                if (low[p] == index[p]) {
+                    std::vector<uint32_t> component;
+                    uint32_t q;
+                    do {
+                        q = stack.back();
+                        stack.pop_back();
+                        onStack[q] = 0;
+                        component.push_back(q);
+                    } while (q != p);
+                    emitComponent(net, component);
+                }
+            }
+        }
+        code.push_back(OP_HALT);
+    }
+
+private:
+    static bool driven(const SimNetlist& net, uint32_t p) { return net.driverStart[p + 1] > net.driverStart[p]; }
+
+    void emitComponent(const SimNetlist& net, std::vector<uint32_t>& component) {
+        bool cyclic = component.size() > 1;
+        for (uint32_t k = net.driverStart[component[0]]; k < net.driverStart[component[0] + 1] && !cyclic; k++) {
+            const SimNetlist::Mos& mos = net.mosfets[net.drivers[k]];
+            cyclic = mos.gate == component[0] || mos.source == component[0];
+        }
+        size_t loopStart = code.size();
+        if (cyclic) {
+            code.push_back(OP_LOOP);
+            code.push_back(static_cast<uint32_t>(component.size()));
+            loops++;
+        }
+        // Tarjan弹出的顺序与依赖顺序相反
+        for (size_t i = component.size(); i-- > 0;) {
+            uint32_t p = component[i];
+            if (absorbed[p]) continue;
+            if (gateOf[p] >= 0 && gates[gateOf[p]].kind != "inv") {
+                emitGate(net, gates[gateOf[p]]);
+            } else {
+                emitNode(net, p);
+            }
+        }
+        if (cyclic) {
+            code.push_back(OP_REPEAT);
+            code.push_back(static_cast<uint32_t>(loopStart));
+        }
+    }
+    void emitGate(const SimNetlist& net, const CmosGate& gate) {
+        bool nand = gate.kind.compare(0, 4, "nand") == 0, nor = gate.kind.compare(0, 3, "nor") == 0;
+        uint32_t op = nand ? OP_NAND : nor ? OP_NOR : OP_GATE;
+        code.insert(code.end(), {op, gate.output * SIM_WORDS, 0, static_cast<uint32_t>(gate.inputs.size())});
+        size_t skip = code.size() - 2;
+        for (uint32_t p : gate.inputs) code.push_back(p * SIM_WORDS);
+        if (op == OP_GATE) {
+            code.push_back(static_cast<uint32_t>(gate.pulldown.size()));
+            code.insert(code.end(), gate.pulldown.begin(), gate.pulldown.end());
+        }
+        size_t start = code.size();
+        for (uint32_t p : gate.nodes) emitNode(net, p);
+        code[skip] = static_cast<uint32_t>(code.size() - start);
+    }
+    void emitNode(const SimNetlist& net, uint32_t p) {
+        uint32_t first = net.driverStart[p], count = net.driverStart[p + 1] - first;
+        if (count == 2) {
+            const SimNetlist::Mos& a = net.mosfets[net.drivers[first]];
+            const SimNetlist::Mos& b = net.mosfets[net.drivers[first + 1]];
+            const SimNetlist::Mos& up = a.type == PMOS ? a : b;
+            const SimNetlist::Mos& down = a.type == PMOS ? b : a;
+            if (a.type != b.type && a.gate == b.gate && net.vcc >= 0 && net.gnd >= 0 &&
+                up.source == net.vcc && down.source == net.gnd) {
+                code.insert(code.end(), {OP_INV, p * SIM_WORDS, a.gate * SIM_WORDS});
+                return;
+            }
+        }
+        code.insert(code.end(), {OP_RESOLVE, p * SIM_WORDS});
+        for (uint32_t k = first; k < first + count; k++) {
+            const SimNetlist::Mos& mos = net.mosfets[net.drivers[k]];
+            code.insert(code.end(), {mos.type == PMOS ? OP_PDRIVE : OP_NDRIVE, mos.source * SIM_WORDS, mos.gate * SIM_WORDS});
+        }
+        code.insert(code.end(), {OP_STORE, p * SIM_WORDS});
+    }
+
+    std::vector<int> gateOf;
+    std::vector<char> absorbed;
+};
+
+// 执行SimProgram的虚拟机, 接口与BitSim相同; GCC/Clang下用computed goto逐条分派
+class SimVM {
+public:
+    SimVM(const SimNetlist& net, const SimProgram& program)
+        : net(net), program(program), zero(net.portCount * SIM_WORDS), one(net.portCount * SIM_WORDS) {}
+
+    void runBlock(uint64_t base) {
+        seedBlock(net, zero, one, base);
+        execute();
+    }
+    // 任意SIM_BLOCK组输入: 输入j在第k个字中的取值为bits[j * SIM_WORDS + k]
+    void runLanes(const uint64_t* bits) {
+        seedInputs(net, zero, one, [&](size_t j, int k) { return bits[j * SIM_WORDS + k]; });
+        execute();
+    }
+    // 输入也可为Z/X: 两个位平面分别给出
+    void runPlanes(const uint64_t* zeroBits, const uint64_t* oneBits) {
+        seedPlanes(net, zero, one, [&](size_t j, int k) { return zeroBits[j * SIM_WORDS + k]; },
+                   [&](size_t j, int k) { return oneBits[j * SIM_WORDS + k]; });
+        execute();
+    }
+    STATE state(uint32_t p, uint64_t lane) const { return laneState(zero, one, p, lane); }
+
+private:
+    void execute() {
+        const uint32_t* code = program.code.data();
+        uint64_t* z = zero.data();
+        uint64_t* o = one.data();
+        uint64_t acc0[SIM_WORDS], acc1[SIM_WORDS];
+        uint64_t changed = 0;
+        size_t pc = 0, passes = 0, limit = 0;
+#if defined(__GNUC__)
+        static const void* labels[] = {&&L_RESOLVE, &&L_NDRIVE, &&L_PDRIVE, &&L_STORE, &&L_INV, &&L_GATE,
+                                       &&L_NAND, &&L_NOR, &&L_LOOP, &&L_REPEAT, &&L_HALT};
+#define VM_NEXT goto *labels[code[pc]]
+#define VM_OP(name) L_##name:
+        VM_NEXT;
+#else
+#define VM_NEXT continue
+#define VM_OP(name) case OP_##name:
+        for (;;) switch (code[pc]) {
+#endif
+        VM_OP(RESOLVE) {
+            const uint64_t* d0 = z + code[pc + 1];
+            const uint64_t* d1 = o + code[pc + 1];
+            for (int k = 0; k < SIM_WORDS; k++) {
+                acc0[k] = d0[k];
+                acc1[k] = d1[k];
+            }
+            pc += 2;
+            VM_NEXT;
+        }
+        VM_OP(NDRIVE) {
+            const uint64_t *s0 = z + code[pc + 1], *s1 = o + code[pc + 1];
+            const uint64_t *g0 = z + code[pc + 2], *g1 = o + code[pc + 2];
+            for (int k = 0; k < SIM_WORDS; k++) {
+                acc0[k] |= g1[k] & (s0[k] | g0[k]);
+                acc1[k] |= g1[k] & (s1[k] | g0[k]);
+            }
+            pc += 3;
+            VM_NEXT;
+        }
+        VM_OP(PDRIVE) {
+            const uint64_t *s0 = z + code[pc + 1], *s1 = o + code[pc + 1];
+            const uint64_t *g0 = z + code[pc + 2], *g1 = o + code[pc + 2];
+            for (int k = 0; k < SIM_WORDS; k++) {
+                acc0[k] |= g0[k] & (s0[k] | g1[k]);
+                acc1[k] |= g0[k] & (s1[k] | g1[k]);
+            }
+            pc += 3;
+            VM_NEXT;
+        }
+        VM_OP(STORE) {
+            uint64_t *d0 = z + code[pc + 1], *d1 = o + code[pc + 1];
+            for (int k = 0; k < SIM_WORDS; k++) {
+                changed |= (acc0[k] ^ d0[k]) | (acc1[k] ^ d1[k]);
+                d0[k] = acc0[k];
+                d1[k] = acc1[k];
+            }
+            pc += 2;
+            VM_NEXT;
+        }
+        VM_OP(INV) {
+            // 上拉在栅极可能为0时驱动1, 下拉在栅极可能为1时驱动0
+            uint64_t *d0 = z + code[pc + 1], *d1 = o + code[pc + 1];
+            const uint64_t *g0 = z + code[pc + 2], *g1 = o + code[pc + 2];
+            for (int k = 0; k < SIM_WORDS; k++) {
+                uint64_t n0 = d0[k] | g1[k], n1 = d1[k] | g0[k];
+                changed |= (n0 ^ d0[k]) | (n1 ^ d1[k]);
+                d0[k] = n0;
+                d1[k] = n1;
+            }
+            pc += 3;
+            VM_NEXT;
+        }
+        VM_OP(GATE) {
+            uint32_t inputs = code[pc + 3];
+            const uint32_t* in = code + pc + 4;
+            const uint32_t* expr = in + inputs + 1;
+            uint32_t length = in[inputs];
+            size_t next = pc + 5 + inputs + length;
+            // 有Z/X输入(两个位平面相同)的组存在时执行开关级指令
+            uint64_t invalid = 0;
+            for (uint32_t i = 0; i < inputs; i++) {
+                for (int k = 0; k < SIM_WORDS; k++) invalid |= ~(z[in[i] + k] ^ o[in[i] + k]);
+            }
+            if (invalid) {
+                pc = next;
+                VM_NEXT;
+            }
+            uint64_t stack[CmosGate::MAX_MOSFETS][SIM_WORDS];
+            int top = -1;
+            for (uint32_t t = 0; t < length; t++) {
+                if (expr[t] == CmosGate::AND) {
+                    for (int k = 0; k < SIM_WORDS; k++) stack[top - 1][k] &= stack[top][k];
+                    top--;
+                } else if (expr[t] == CmosGate::OR) {
+                    for (int k = 0; k < SIM_WORDS; k++) stack[top - 1][k] |= stack[top][k];
+                    top--;
+                } else {
+                    top++;
+                    for (int k = 0; k < SIM_WORDS; k++) stack[top][k] = o[in[expr[t]] + k];
+                }
+            }
+            changed |= storeGate(z + code[pc + 1], o + code[pc + 1], stack[0]);
+            pc = next + code[pc + 2];
+            VM_NEXT;
+        }
+        VM_OP(NAND) {
+            uint32_t inputs = code[pc + 3];
+            const uint32_t* in = code + pc + 4;
+            uint64_t invalid = 0, pd[SIM_WORDS];
+            for (int k = 0; k < SIM_WORDS; k++) pd[k] = ~0ull;
+            for (uint32_t i = 0; i < inputs; i++) {
+                for (int k = 0; k < SIM_WORDS; k++) {
+                    invalid |= ~(z[in[i] + k] ^ o[in[i] + k]);
+                    pd[k] &= o[in[i] + k];
+                }
+            }
+            pc += 4 + inputs;
+            if (!invalid) {
+                changed |= storeGate(z + code[pc - inputs - 3], o + code[pc - inputs - 3], pd);
+                pc += code[pc - inputs - 2];
+            }
+            VM_NEXT;
+        }
+        VM_OP(NOR) {
+            uint32_t inputs = code[pc + 3];
+            const uint32_t* in = code + pc + 4;
+            uint64_t invalid = 0, pd[SIM_WORDS] = {};
+            for (uint32_t i = 0; i < inputs; i++) {
+                for (int k = 0; k < SIM_WORDS; k++) {
+                    invalid |= ~(z[in[i] + k] ^ o[in[i] + k]);
+                    pd[k] |= o[in[i] + k];
+                }
+            }
+            pc += 4 + inputs;
+            if (!invalid) {
+                changed |= storeGate(z + code[pc - inputs - 3], o + code[pc - inputs - 3], pd);
+                pc += code[pc - inputs - 2];
+            }
+            VM_NEXT;
+        }
+        VM_OP(LOOP) {
+            // 每个端口的状态最多改变两次, 循环次数有上界
+            changed = 0;
+            passes = 0;
+            limit = 2 * code[pc + 1] + 1;
+            pc += 2;
+            VM_NEXT;
+        }
+        VM_OP(REPEAT) {
+            if (changed) {
+                if (++passes > limit) throw std::runtime_error("Error:仿真未收敛");
+                changed = 0;
+                pc = code[pc + 1] + 2;
+            } else {
+                pc += 2;
+            }
+            VM_NEXT;
+        }
+        VM_OP(HALT) {
+            return;
+        }
+#if !defined(__GNUC__)
+        }
+#endif
+#undef VM_NEXT
+#undef VM_OP
+    }
+
+    // 输入全为0/1时门的输出: 下拉导通为0, 否则为1(与原状态合并), 返回是否改变
+    static uint64_t storeGate(uint64_t* y0, uint64_t* y1, const uint64_t* pd) {
+        uint64_t changed = 0;
+        for (int k = 0; k < SIM_WORDS; k++) {
+            uint64_t n0 = y0[k] | pd[k], n1 = y1[k] | ~pd[k];
+            changed |= (n0 ^ y0[k]) | (n1 ^ y1[k]);
+            y0[k] = n0;
+            y1[k] = n1;
+        }
+        return changed;
+    }
+
+    const SimNetlist& net;
+    const SimProgram& program;
+    std::vector<uint64_t> zero;
+    std::vector<uint64_t> one;
+};
+
+// 宏模型: 子模块定义从输入到输出的函数, 按输入的四值组合(STATE 0..3, 每个输入2位)预先算成查找表, 同一定义的
+// 所有实例共用. 仿真语义是单调的, 表中的值即实例在该边界输入下的最小不动点, 输入为Z/X时同样精确.
+// 模块内部驱动其输入端口(或VCC/GND)、读取其输出端口时实例与外部相互影响, 不建表(ok为false)
+const uint32_t MACRO_MAX_INPUTS = 6;
+
+struct MacroModel {
+    bool ok = false;
+    uint32_t inputs = 0;
+    uint32_t outputs = 0;
+    std::vector<uint8_t> lut;  // lut[组合 * outputs + j]: 该组输入下输出j的状态
+
+    void compile(ModuleNode* def) {
+        ModuleNode* flat = def->flatten();
+        const SimNetlist& net = flat->compiled();
+        inputs = static_cast<uint32_t>(net.inputs.size());
+        outputs = static_cast<uint32_t>(net.outputs.size());
+        if (inputs > MACRO_MAX_INPUTS || outputs == 0) return;
+        auto driven = [&](long long p) { return p >= 0 && net.driverStart[p] != net.driverStart[p + 1]; };
+        for (uint32_t p : net.inputs) {
+            if (driven(p)) return;
+        }
+        if (driven(net.vcc) || driven(net.gnd)) return;
+        for (uint32_t p : net.outputs) {
+            if (net.fanoutStart[p] != net.fanoutStart[p + 1]) return;
+        }
+        // 4^k种组合按SIM_BLOCK组一批交给字节码仿真
+        uint64_t rows = 1ull << (2 * inputs);
+        lut.resize(rows * outputs);
+        SimVM vm(net, flat->bytecode());
+        std::vector<uint64_t> zeros(inputs * SIM_WORDS), ones(inputs * SIM_WORDS);
+        for (uint64_t base = 0; base < rows; base += SIM_BLOCK) {
+            std::fill(zeros.begin(), zeros.end(), 0);
+            std::fill(ones.begin(), ones.end(), 0);
+            for (uint64_t lane = 0; lane < SIM_BLOCK && base + lane < rows; lane++) {
+                for (uint32_t j = 0; j < inputs; j++) {
+                    uint64_t s = ((base + lane) >> (2 * j)) & 3, bit = 1ull << (lane % 64);
+                    if (s == ZERO || s == X) zeros[j * SIM_WORDS + lane / 64] |= bit;
+                    if (s == ONE || s == X) ones[j * SIM_WORDS + lane / 64] |= bit;
+                }
+            }
+            vm.runPlanes(zeros.data(), ones.data());
+            for (uint64_t lane = 0; lane < SIM_BLOCK && base + lane < rows; lane++) {
+                for (uint32_t j = 0; j < outputs; j++) lut[(base + lane) * outputs + j] = vm.state(net.outputs[j], lane);
+            }
+        }
+        ok = true;
+    }
+};
+
+// 按宏模型组织的网表: 能用宏模型的子模块实例作为一个查表单元, 其余实例逐层展开, 直到遇到能用宏模型的
+// 实例或晶体管. 端口编号与compiled()相同; 被宏模型代替的实例内部端口不求值(保持Z)
+struct MacroNetlist {
+    struct Macro {
+        const MacroModel* model;
+        uint32_t firstPin;  // pins中先是各输入端口, 接着是各输出端口
+    };
+    std::vector<SimNetlist::Mos> mosfets;
+    std::vector<Macro> macros;
+    std::vector<uint32_t> pins;
+    // 单元编号: 晶体管为0..mosfets.size()-1, 宏单元依次排在后面. CSR: 读取/驱动端口p的单元
+    std::vector<uint32_t> readerStart;
+    std::vector<uint32_t> readers;
+    std::vector<uint32_t> driverStart;
+    std::vector<uint32_t> drivers;
+    size_t absorbed = 0;  // 被宏模型代替的晶体管数
+    LevelNetlist level;   // 有宏单元时按分量编译的结果, 宏单元为分量
+
+    // flat为展开后的模块(端口与其compiled()一致)
+    void compile(ModuleNode* flat) {
+        top = flat;
+        for (size_t i = 0; i < flat->ports.size(); i++) index.emplace(flat->ports[i], static_cast<uint32_t>(i));
+        // 外部驱动VCC/GND时宏模型中的电源不再是常量, 全部按晶体管展开
+        const SimNetlist& net = flat->compiled();
+        auto driven = [&](long long p) { return p >= 0 && net.driverStart[p] != net.driverStart[p + 1]; };
+        macroAllowed = !driven(net.vcc) && !driven(net.gnd);
+        place(flat, 0, true, {});
+        index.clear();
+        uint32_t ports = static_cast<uint32_t>(flat->ports.size());
+        uint32_t cells = static_cast<uint32_t>(mosfets.size() + macros.size());
+        auto build = [&](std::vector<uint32_t>& start, std::vector<uint32_t>& list, auto each) {
+            start.assign(ports + 1, 0);
+            for (uint32_t c = 0; c < cells; c++) each(c, [&](uint32_t p) { start[p + 1]++; });
+            for (uint32_t p = 0; p < ports; p++) start[p + 1] += start[p];
+            list.resize(start[ports]);
+            std::vector<uint32_t> next(start.begin(), start.end() - 1);
+            for (uint32_t c = 0; c < cells; c++) each(c, [&](uint32_t p) { list[next[p]++] = c; });
+        };
+        build(readerStart, readers, [&](uint32_t c, auto add) {
+            if (c < mosfets.size()) {
+                add(mosfets[c].gate);
+                if (mosfets[c].source != mosfets[c].gate) add(mosfets[c].source);
+            } else {
+                const Macro& m = macros[c - mosfets.size()];
+                for (uint32_t k = 0; k < m.model->inputs; k++) add(pins[m.firstPin + k]);
+            }
+        });
+        build(driverStart, drivers, [&](uint32_t c, auto add) {
+            if (c < mosfets.size()) {
+                add(mosfets[c].drain);
+            } else {
+                const Macro& m = macros[c - mosfets.size()];
+                for (uint32_t k = 0; k < m.model->outputs; k++) add(pins[m.firstPin + m.model->inputs + k]);
+            }
+        });
+        if (!macros.empty()) level.compile(net, *this);
+    }
+
+private:
+    // m为某一层的展开模块, prefix为它在顶层中的实例路径; io为其输入输出端口在顶层的端口编号
+    void place(ModuleNode* m, Symbol prefix, bool isTop, const std::unordered_map<Symbol, uint32_t>& io) {
+        auto resolve = [&](Symbol name) {
+            auto it = io.find(name);
+            if (it != io.end()) return it->second;
+            // power端口展开时不加前缀
+            PortNode* own = m->findPort(name);
+            bool keep = isTop || (own != nullptr && own->type == POWER);
+            PortNode* p = top->findPort(keep ? name : symbols().intern(prefix, name));
+            if (p == nullptr) throw std::runtime_error("Error:宏模型展开时找不到端口" + symName(name));
+            return index.at(p);
+        };
+        std::unordered_set<const MosNode*> inInstance;
+        for (auto& sub : m->subModules) inInstance.insert(sub->mosfets.begin(), sub->mosfets.end());
+        for (auto& mos : m->mosfets) {
+            if (inInstance.count(mos)) continue;
+            mosfets.push_back({static_cast<uint32_t>(mos->type), resolve(mos->gate), resolve(mos->source), resolve(mos->drain)});
+        }
+        for (auto& sub : m->subModules) {
+            ModuleNode* child = sub->module->flatten();
+            // 参数与子模块的输入输出端口按声明顺序对应(同flatten)
+            std::unordered_map<Symbol, uint32_t> childIo;
+            std::vector<uint32_t> in, out;
+            size_t k = 0;
+            for (auto& p : child->ports) {
+                if (p->type != INPUT && p->type != OUTPUT) continue;
+                uint32_t pin = resolve(sub->parameters[k++]);
+                childIo[p->name] = pin;
+                (p->type == INPUT ? in : out).push_back(pin);
+            }
+            bool feedback = std::any_of(out.begin(), out.end(), [&](uint32_t p) {
+                return std::find(in.begin(), in.end(), p) != in.end();
+            });
+            const MacroModel* model = macroAllowed && !feedback ? &sub->module->macroModel() : nullptr;
+            if (model != nullptr && model->ok) {
+                macros.push_back({model, static_cast<uint32_t>(pins.size())});
+                pins.insert(pins.end(), in.begin(), in.end());
+                pins.insert(pins.end(), out.begin(), out.end());
+                absorbed += child->mosfets.size();
+            } else {
+                place(child, isTop ? sub->name : symbols().intern(prefix, sub->name), false, childIo);
+            }
+        }
+    }
+
+    ModuleNode* top = nullptr;
+    bool macroAllowed = true;
+    std::unordered_map<const PortNode*, uint32_t> index;
+};
+
+inline bool LevelNetlist::compile(const SimNetlist& net, const MacroNetlist& macro) {
+    std::unordered_map<const MacroModel*, uint64_t> shared;
+    std::vector<Cell> cells;
+    for (auto& m : macro.macros) {
+        auto it = shared.find(m.model);
+        if (it == shared.end()) {
+            it = shared.emplace(m.model, luts.size()).first;
+            luts.insert(luts.end(), m.model->lut.begin(), m.model->lut.end());
+        }
+        const uint32_t* pin = &macro.pins[m.firstPin];
+        cells.push_back({{pin, pin + m.model->inputs},
+                         {pin + m.model->inputs, pin + m.model->inputs + m.model->outputs}, it->second});
+    }
+    return build(net, macro.mosfets, cells);
+}
+
+// 宏模型网表上的事件驱动仿真, 接口与EventSim相同: 晶体管按开关级求值, 宏单元在输入改变时查表驱动输出
+class MacroSim {
+public:
+    MacroSim(const SimNetlist& net, const MacroNetlist& macro)
+        : net(net), macro(macro), states(net.portCount, Z), queued(net.portCount, 0), mark(net.portCount, 0),
+          inputIndex(net.portCount, -1) {
+        for (size_t j = 0; j < net.inputs.size(); j++) inputIndex[net.inputs[j]] = static_cast<int>(j);
+    }
+
+    size_t run(const std::vector<STATE>& in) {
+        std::fill(states.begin(), states.end(), Z);
+        evaluated = 0;
+        last = in;
+        settled = true;
+        if (net.vcc >= 0) drive(net.vcc, ONE);
+        if (net.gnd >= 0) drive(net.gnd, ZERO);
+        for (size_t j = 0; j < net.inputs.size(); j++) drive(net.inputs[j], in[j]);
+        // 输入全为Z时输出也可能不为Z, 每个宏单元先求值一次
+        for (size_t c = 0; c < macro.macros.size(); c++) eval(static_cast<uint32_t>(macro.mosfets.size() + c));
+        propagate();
+        cone.clear();
+        return evaluated;
+    }
+    // 同EventSim::update: 改变的输入的传递扇出清为Z后重新传播
+    size_t update(const std::vector<STATE>& in) {
+        if (!settled) return run(in);
+        evaluated = 0;
+        cone.clear();
+        if (++epoch == 0) {
+            std::fill(mark.begin(), mark.end(), 0);
+            epoch = 1;
+        }
+        for (size_t j = 0; j < net.inputs.size(); j++) {
+            if (in[j] != last[j]) addToCone(net.inputs[j]);
+        }
+        last = in;
+        for (size_t head = 0; head < cone.size(); head++) {
+            uint32_t p = cone[head];
+            for (uint32_t k = macro.readerStart[p]; k < macro.readerStart[p + 1]; k++) {
+                uint32_t c = macro.readers[k];
+                if (c < macro.mosfets.size()) {
+                    addToCone(macro.mosfets[c].drain);
+                } else {
+                    const MacroNetlist::Macro& m = macro.macros[c - macro.mosfets.size()];
+                    for (uint32_t j = 0; j < m.model->outputs; j++) addToCone(macro.pins[m.firstPin + m.model->inputs + j]);
+                }
+            }
+        }
+        for (uint32_t p : cone) states[p] = Z;
+        for (uint32_t p : cone) {
+            if (p == net.vcc) drive(p, ONE);
+            if (p == net.gnd) drive(p, ZERO);
+            if (inputIndex[p] >= 0) drive(p, in[inputIndex[p]]);
+            for (uint32_t k = macro.driverStart[p]; k < macro.driverStart[p + 1]; k++) eval(macro.drivers[k]);
+        }
+        propagate();
+        return evaluated;
+    }
+    STATE state(uint32_t p) const { return states[p]; }
+    const std::vector<uint32_t>& changed() const { return cone; }
+
+private:
+    static STATE merge(STATE old, STATE s) {
+        if (s == Z || old == s || old == X) return old;
+        return old == Z ? s : X;
+    }
+    void drive(uint32_t p, STATE s) {
+        STATE n = merge(states[p], s);
+        if (n == states[p]) return;
+        states[p] = n;
+        if (!queued[p]) {
+            queued[p] = 1;
+            queue.push_back(p);
+        }
+    }
+    void propagate() {
+        size_t limit = 2 * net.portCount;
+        for (size_t head = 0; head < queue.size(); head++) {
+            if (head >= limit) {
+                throw std::runtime_error("Error:仿真未收敛");
+            }
+            uint32_t p = queue[head];
+            queued[p] = 0;
+            for (uint32_t k = macro.readerStart[p]; k < macro.readerStart[p + 1]; k++) eval(macro.readers[k]);
+        }
+        queue.clear();
+    }
+    void eval(uint32_t c) {
+        evaluated++;
+        if (c < macro.mosfets.size()) {
+            const SimNetlist::Mos& mos = macro.mosfets[c];
+            STATE g = states[mos.gate];
+            if (g == Z) return;
+            if (g == X) {
+                drive(mos.drain, X);
+            } else if (g == (mos.type == PMOS ? ZERO : ONE)) {
+                drive(mos.drain, states[mos.source]);
+            }
+            return;
+        }
+        const MacroNetlist::Macro& m = macro.macros[c - macro.mosfets.size()];
+        const uint32_t* pin = &macro.pins[m.firstPin];
+        uint64_t e = 0;
+        for (uint32_t k = 0; k < m.model->inputs; k++) e |= uint64_t(states[pin[k]]) << (2 * k);
+        const uint8_t* row = &m.model->lut[e * m.model->outputs];
+        for (uint32_t k = 0; k < m.model->outputs; k++) drive(pin[m.model->inputs + k], static_cast<STATE>(row[k]));
+    }
+    void addToCone(uint32_t p) {
+        if (mark[p] == epoch) return;
+        mark[p] = epoch;
+        cone.push_back(p);
+    }
+
+    const SimNetlist& net;
+    const MacroNetlist& macro;
+    std::vector<STATE> states;
+    std::vector<uint8_t> queued;
+    std::vector<uint32_t> queue;
+    size_t evaluated = 0;
+    bool settled = false;
+    std::vector<STATE> last;
+    std::vector<uint32_t> mark;
+    uint32_t epoch = 0;
+    std::vector<uint32_t> cone;
+    std::vector<int> inputIndex;
+};
+
+const SimNetlist& ModuleNode::compiled() {
+    if (sim == nullptr) {
+        sim = arena.make<SimNetlist>();
+        sim->compile(*this);
+    }
+    return *sim;
+}
+
+const LevelNetlist& ModuleNode::levelized() {
+    if (levels == nullptr) {
+        levels = arena.make<LevelNetlist>();
+        levels->compile(compiled());
+    }
+    return *levels;
+}
+
+const SimProgram& ModuleNode::bytecode() {
+    if (program == nullptr) {
+        program = arena.make<SimProgram>();
+        program->compile(compiled());
+    }
+    return *program;
+}
+
+const MacroModel& ModuleNode::macroModel() {
+    if (macro == nullptr) {
+        macro = arena.make<MacroModel>();
+        macro->compile(this);
+    }
+    return *macro;
+}
+
+const MacroNetlist& ModuleNode::macroNetlist() {
+    if (macros == nullptr) {
+        macros = arena.make<MacroNetlist>();
+        macros->compile(this);
+    }
+    return *macros;
+}
+
+// 分量查表所用的网表: 有宏单元且能按分量编译时用宏模型网表(分量更少), 否则用晶体管级的分量; 都不能时为nullptr
+inline const LevelNetlist* levelNetlist(ModuleNode* m) {
+    const LevelNetlist& macro = m->macroNetlist().level;
+    if (macro.ok) return &macro;
+    return m->levelized().ok ? &m->levelized() : nullptr;
+}
+
+// 交互仿真: 保留上次的结果, 只传播改变的输入; 第一次回写全部端口, 之后只回写重算过的端口
+template <class Sim>
+size_t updateSession(Sim& sim, bool first, const std::vector<STATE>& in, std::vector<PortNode*>& ports) {
+    size_t evaluated = sim.update(in);
+    if (first) {
+        for (size_t i = 0; i < ports.size(); i++) ports[i]->state = sim.state(i);
+    } else {
+        for (uint32_t p : sim.changed()) ports[p]->state = sim.state(p);
+    }
+    return evaluated;
+}
+
+size_t ModuleNode::trigger(const std::vector<STATE>& inputs_state) {
+    if (inputs_state.size() != inputs.size()) {
+        throw std::runtime_error("inputs size doens't match");
+    }
+    // 能按分量编译的模块查表求值, 有反馈的模块用事件驱动仿真; 有宏单元时都在宏模型网表上进行,
+    // 被宏模型代替的实例内部端口不求值(保持Z), 输入输出端口的结果不变
+    if (const LevelNetlist* level = levelNetlist(this)) {
+        bool first = levelSession == nullptr;
+        if (first) levelSession = arena.make<LevelSim>(compiled(), *level);
+        return updateSession(*levelSession, first, inputs_state, ports);
+    }
+    if (!macroNetlist().macros.empty()) {
+        bool first = macroSession == nullptr;
+        if (first) macroSession = arena.make<MacroSim>(compiled(), macroNetlist());
+        return updateSession(*macroSession, first, inputs_state, ports);
+    }
+    bool first = session == nullptr;
+    if (first) session = arena.make<EventSim>(compiled());
+    return updateSession(*session, first, inputs_state, ports);
+}
+
+// 真值表输出: 各模块的输入空间在运行时才按SIM_CHUNK行切块, 由线程池仿真(每个线程有自己的SimVM),
+// 各块的文本按行序写出. 同时在写缓冲区中的块数有上限, 内存占用与行数无关
+const uint64_t SIM_CHUNK = 64 * SIM_BLOCK;
+
+// 二进制真值表(-mb): TABLE_MAGIC, u32版本, u32保留(0), 之后依次为各张表, 每张表为表头加数据.
+// 表头: 模块名, u32输入数, u32输出数, u32标志, u32每行字节数, u64行数, 各输入名, 各输出名(名称均为u32长度+字节).
+// 数据: 每行定长, 可按行号直接定位. 有TABLE_SAMPLED标志时行首为ceil(输入数/8)字节的输入位(同激励文件),
+// 否则第r行的输入j为r的第j位; 之后为输出, 每个输出2位(STATE的值), 输出j为第j/4字节的第2*(j%4)位起
+const char TABLE_MAGIC[8] = {'S', 'E', 'D', 'A', 'T', 'A', 'B', '\0'};
+const uint32_t TABLE_VERSION = 1;
+const uint32_t TABLE_SAMPLED = 1;
+
+enum TableFormat { TABLE_TEXT, TABLE_MARKDOWN, TABLE_BINARY };
+
+class TableWriter {
+public:
+    // gray: 逐行按格雷码顺序增量仿真(每行只改变一个输入), 代替位并行仿真; 输出仍按自然顺序.
+    // 能按分量编译的模块查表(LevelSim, 有宏单元时在宏模型网表上), 有反馈的用MacroSim或EventSim
+    TableWriter(std::ostream& out, TableFormat format, bool gray = false)
+        : out(out), markdown(format == TABLE_MARKDOWN), binary(format == TABLE_BINARY), gray(gray) {
+        if (binary) {
+            std::string header(TABLE_MAGIC, sizeof(TABLE_MAGIC));
+            put32(header, TABLE_VERSION);
+            put32(header, 0);
+            parts.push_back({nullptr, 0, std::move(header)});
+        }
+    }
+
+    // 抽样: 之后加入的表行数超过count时, 改为随机抽取count组输入(结果只由seed决定, 与线程数无关).
+    // bias为按输入名给出的取1概率, 0或1即固定该输入; 未给出的输入取0/1各一半
+    void sampling(uint64_t count, uint64_t seed, std::map<std::string, double> bias) {
+        sampleCount = count;
+        sampleSeed = seed;
+        sampleBias = std::move(bias);
+    }
+    // 追加一段固定文本(二进制格式中忽略)
+    void text(std::string s) {
+        if (binary) return;
+        parts.push_back({nullptr, 0, std::move(s)});
+    }
+    // 追加模块(应为flatten()的结果)的表头和全部行; 网表在这里编译, 仿真线程只读
+    void module(ModuleNode* m) {
+        const LevelNetlist* level = gray ? levelNetlist(m) : nullptr;
+        std::vector<std::string> inputNames, outputNames;
+        for (auto& p : m->inputs) inputNames.push_back(symName(p->name));
+        for (auto& p : m->outputs) outputNames.push_back(symName(p->name));
+        table(symName(m->name), &m->compiled(), &m->bytecode(), level, inputNames, outputNames);
+        // 不能按分量查表时, 有可用宏模型的子模块实例就用宏模型上的事件仿真(同trigger)
+        if (gray && level == nullptr && !m->macroNetlist().macros.empty()) modules.back().macro = &m->macroNetlist();
+    }
+    // 按输出锥分别列表: 每个输出只对其支撑集(结构上能影响它的输入)穷举. 支撑集被另一输出的支撑集包含时
+    // 并入那张表, 各表行数之和不小于完整真值表时直接输出完整真值表
+    void cones(ModuleNode* m) {
+        const SimNetlist& net = m->compiled();
+        std::vector<std::vector<uint32_t>> support(net.outputs.size());
+        std::vector<size_t> order(net.outputs.size());
+        for (size_t j = 0; j < net.outputs.size(); j++) {
+            support[j] = net.support(net.outputs[j]);
+            order[j] = j;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return support[a].size() > support[b].size();
+        });
+        // 支撑集从大到小, 能放入已有组的输出不单独成表
+        std::vector<size_t> owner(net.outputs.size());
+        std::vector<size_t> leaders;
+        for (size_t j : order) {
+            auto it = std::find_if(leaders.begin(), leaders.end(), [&](size_t l) {
+                return std::includes(support[l].begin(), support[l].end(), support[j].begin(), support[j].end());
+            });
+            if (it == leaders.end()) {
+                owner[j] = leaders.size();
+                leaders.push_back(j);
+            } else {
+                owner[j] = it - leaders.begin();
+            }
+        }
+        double rows = 0;
+        for (size_t l : leaders) rows += std::ldexp(1.0, static_cast<int>(support[l].size()));
+        if (leaders.empty() || rows >= std::ldexp(1.0, static_cast<int>(net.inputs.size()))) {
+            module(m);
+            return;
+        }
+        // 各组按组内第一个输出的原顺序排列, 组内输出保持原顺序
+        std::vector<std::vector<uint32_t>> groups, supports;
+        std::vector<long long> slot(leaders.size(), -1);
+        for (size_t j = 0; j < net.outputs.size(); j++) {
+            size_t g = owner[j];
+            if (slot[g] < 0) {
+                slot[g] = static_cast<long long>(groups.size());
+                groups.emplace_back();
+                supports.push_back(support[leaders[g]]);
+            }
+            groups[slot[g]].push_back(net.outputs[j]);
+        }
+        for (size_t g = 0; g < groups.size(); g++) {
+            coneNets.push_back(net.cone(groups[g]));
+            const SimNetlist& cone = coneNets.back();
+            conePrograms.emplace_back();
+            conePrograms.back().compile(cone);
+            const LevelNetlist* level = nullptr;
+            if (gray) {
+                coneLevels.emplace_back();
+                if (coneLevels.back().compile(cone)) level = &coneLevels.back();
+            }
+            std::vector<std::string> inputNames, outputNames;
+            for (uint32_t j : supports[g]) inputNames.push_back(symName(m->inputs[j]->name));
+            std::string title = markdown ? "### cone" : "cone";
+            for (uint32_t o : groups[g]) {
+                outputNames.push_back(symName(m->ports[o]->name));
+                title += " " + outputNames.back();
+            }
+            text(title + (markdown ? "\n" : " (" + std::to_string(inputNames.size()) + " inputs)\n"));
+            table(symName(m->name), &cone, &conePrograms.back(), level, inputNames, outputNames);
+        }
+    }
+    // 用threads个线程仿真并按顺序写出全部内容
+    void run(unsigned threads) {
+        size_t count = 0;
+        for (auto& p : parts) count += std::max<uint64_t>(1, (p.rows + SIM_CHUNK - 1) / SIM_CHUNK);
+        Cursor cursor{&parts};
+        size_t workers = std::min<size_t>(threads, count);
+        if (workers <= 1) {
+            Worker w;
+            std::string buf;
+            while (!cursor.done()) {
+                buf.clear();
+                produce(cursor.take(), w, buf);
+                out << buf;
+            }
+            return;
+        }
+        size_t window = 4 * workers;
+        std::vector<std::string> slots(window);
+        std::vector<char> ready(window, 0);
+        size_t next = 0, written = 0;
+        bool stop = false;
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable cv;
+        auto work = [&]() {
+            Worker w;
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                cv.wait(lock, [&]() { return stop || next == count || next < written + window; });
+                if (stop || next == count) return;
+                size_t i = next++;
+                Chunk c = cursor.take();
+                lock.unlock();
+                std::string buf;
+                try {
+                    produce(c, w, buf);
+                } catch (...) {
+                    lock.lock();
+                    if (!error) error = std::current_exception();
+                    stop = true;
+                    cv.notify_all();
+                    return;
+                }
+                lock.lock();
+                slots[i % window] = std::move(buf);
+                ready[i % window] = 1;
+                cv.notify_all();
+            }
+        };
+        std::vector<std::thread> pool;
+        for (size_t t = 0; t < workers; t++) {
+            pool.emplace_back(work);
+        }
+        std::string buf;
+        for (; written < count; ) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&]() { return stop || ready[written % window]; });
+                if (stop) break;
+                buf = std::move(slots[written % window]);
+                ready[written % window] = 0;
+                written++;
+                cv.notify_all();
+            }
+            out << buf;
+        }
+        for (auto& t : pool) {
+            t.join();
+        }
+        if (error) std::rethrow_exception(error);
+    }
+
+private:
+    void table(const std::string& name, const SimNetlist* net, const SimProgram* program, const LevelNetlist* level,
+               const std::vector<std::string>& inputNames, const std::vector<std::string>& outputNames) {
+        modules.push_back({net, program, level, nullptr, {}, {}, {}, modules.size()});
+        Table& t = modules.back();
+        size_t n = net->inputs.size();
+        uint64_t rows = n < 63 ? 1ull << n : 0;
+        bool sampled = sampleCount > 0 && (rows == 0 || rows > sampleCount);
+        if (rows == 0 && !sampled) {
+            throw std::runtime_error("Error:模块" + name + "有" + std::to_string(n) +
+                                     "个输入, 真值表行数超出范围, 请用-r抽样");
+        }
+        std::string header, note;
+        if (sampled) {
+            // 取1的概率按1/256量化
+            for (auto& name : inputNames) {
+                auto it = sampleBias.find(name);
+                double p = it == sampleBias.end() ? 0.5 : it->second;
+                t.ones.push_back(static_cast<uint32_t>(std::lround(p * 256)));
+            }
+            rows = sampleCount;
+            level = nullptr;
+            t.level = nullptr;
+            note = "random sample: " + std::to_string(sampleCount) + " of 2^" + std::to_string(n) + " rows, seed " +
+                   std::to_string(sampleSeed) + "\n";
+            if (!markdown && !binary) header += note;
+        }
+        if (binary) {
+            t.rowBytes = static_cast<uint32_t>((sampled ? (n + 7) / 8 : 0) + (outputNames.size() + 3) / 4);
+            putName(header, name);
+            put32(header, static_cast<uint32_t>(n));
+            put32(header, static_cast<uint32_t>(outputNames.size()));
+            put32(header, sampled ? TABLE_SAMPLED : 0);
+            put32(header, t.rowBytes);
+            put64(header, rows);
+            for (auto& port : inputNames) putName(header, port);
+            for (auto& port : outputNames) putName(header, port);
+        } else if (markdown) {
+            header += "| Inputs ";
+            for (size_t i = 0; i < inputNames.size(); i++) header += "| ";
+            header += " Outputs ";
+            for (size_t i = 0; i < outputNames.size(); i++) header += "| ";
+            header += "\n|";
+            for (size_t i = 0; i < inputNames.size() + outputNames.size(); i++) header += "---|";
+            header += "\n| ";
+            for (auto& name : inputNames) header += " " + name + " |";
+            for (auto& name : outputNames) header += " " + name + " |";
+            header += "\n";
+        } else {
+            for (auto& name : inputNames) t.inputNames.push_back(name + ": ");
+            for (auto& name : outputNames) t.outputNames.push_back(name + ": ");
+        }
+        parts.push_back({&t, rows, std::move(header)});
+        // md中说明放在表后, 不影响按表头解析
+        if (sampled && markdown) text("\n" + note);
+    }
+
+    struct Table {
+        const SimNetlist* net;
+        const SimProgram* program;
+        const LevelNetlist* level;  // 格雷码模式下可按分量查表时非空
+        const MacroNetlist* macro;  // 格雷码模式下level为空且有可用宏模型时非空
+        std::vector<std::string> inputNames;
+        std::vector<std::string> outputNames;
+        std::vector<uint32_t> ones;  // 抽样时各输入取1的概率(x/256), 不抽样时为空
+        uint64_t id;                 // 表的序号, 与种子一起决定抽样的随机数
+        uint32_t rowBytes = 0;       // 二进制格式中每行的字节数
+    };
+    // 输出的一段: 固定文本, 或表头加一张表的rows行
+    struct Part {
+        const Table* table;
+        uint64_t rows;
+        std::string text;
+    };
+    // 一次仿真和写出的单位; text只在每段的第一块非空
+    struct Chunk {
+        const Table* table;
+        uint64_t begin, end;
+        const std::string* text;
+    };
+    // 按顺序把各段切成不超过SIM_CHUNK行的块, 块在取出时才生成(多线程时在锁内调用)
+    struct Cursor {
+        const std::vector<Part>* parts;
+        size_t part = 0;
+        uint64_t begin = 0;
+        bool done() const { return part == parts->size(); }
+        Chunk take() {
+            const Part& p = (*parts)[part];
+            Chunk c{p.table, begin, std::min(p.rows, begin + SIM_CHUNK), begin == 0 ? &p.text : nullptr};
+            begin = c.end;
+            if (begin >= p.rows) {
+                part++;
+                begin = 0;
+            }
+            return c;
+        }
+    };
+    // 每个线程的仿真状态, 换模块时重建
+    struct Worker {
+        const SimNetlist* net = nullptr;
+        std::unique_ptr<SimVM> sim;
+        std::unique_ptr<EventSim> event;
+        std::unique_ptr<LevelSim> level;
+        std::unique_ptr<MacroSim> macro;
+        std::vector<STATE> states;  // 格雷码模式下本块各行的输出
+        std::vector<uint64_t> lanes;  // 抽样时本批各输入的取值
+    };
+    // 按行号取各输入的值
+    struct RowBits {
+        uint64_t row;
+        uint64_t operator()(size_t j) const { return j < 64 ? (row >> j) & 1 : 0; }
+    };
+
+    void produce(const Chunk& c, Worker& w, std::string& buf) const {
+        if (c.text != nullptr) buf += *c.text;
+        if (c.table == nullptr || c.begin == c.end) return;
+        const SimNetlist& net = *c.table->net;
+        if (w.net != &net) {
+            w.net = &net;
+            w.sim.reset();
+            w.event.reset();
+            w.level.reset();
+            w.macro.reset();
+        }
+        if (!c.table->ones.empty()) {
+            sampleRows(c, w, buf);
+            return;
+        }
+        if (gray) {
+            if (c.table->level != nullptr) {
+                if (!w.level) w.level = std::make_unique<LevelSim>(net, *c.table->level);
+                grayRows(c, *w.level, w.states);
+            } else if (c.table->macro != nullptr) {
+                if (!w.macro) w.macro = std::make_unique<MacroSim>(net, *c.table->macro);
+                grayRows(c, *w.macro, w.states);
+            } else {
+                if (!w.event) w.event = std::make_unique<EventSim>(net);
+                grayRows(c, *w.event, w.states);
+            }
+            size_t outs = net.outputs.size();
+            for (uint64_t row = c.begin; row < c.end; row++) {
+                formatRow(buf, *c.table, RowBits{row}, &w.states[(row - c.begin) * outs]);
+            }
+            return;
+        }
+        if (!w.sim) w.sim = std::make_unique<SimVM>(net, *c.table->program);
+        std::vector<STATE> out(net.outputs.size());
+        for (uint64_t base = c.begin; base < c.end; base += SIM_BLOCK) {
+            w.sim->runBlock(base);
+            for (uint64_t lane = 0; lane < SIM_BLOCK && base + lane < c.end; lane++) {
+                for (size_t j = 0; j < out.size(); j++) out[j] = w.sim->state(net.outputs[j], lane);
+                formatRow(buf, *c.table, RowBits{base + lane}, out.data());
+            }
+        }
+    }
+    // 每块用(种子, 表序号, 块起点)初始化随机数, 各线程分到哪些块都不影响结果
+    void sampleRows(const Chunk& c, Worker& w, std::string& buf) const {
+        const SimNetlist& net = *c.table->net;
+        const std::vector<uint32_t>& ones = c.table->ones;
+        if (!w.sim) w.sim = std::make_unique<SimVM>(net, *c.table->program);
+        std::seed_seq seq{static_cast<uint32_t>(sampleSeed), static_cast<uint32_t>(sampleSeed >> 32),
+                          static_cast<uint32_t>(c.table->id), static_cast<uint32_t>(c.begin / SIM_CHUNK)};
+        std::mt19937_64 rng(seq);
+        size_t n = net.inputs.size();
+        w.lanes.resize(n * SIM_WORDS);
+        std::vector<STATE> out(net.outputs.size());
+        for (uint64_t base = c.begin; base < c.end; base += SIM_BLOCK) {
+            for (size_t j = 0; j < n; j++) {
+                for (int k = 0; k < SIM_WORDS; k++) w.lanes[j * SIM_WORDS + k] = randomWord(rng, ones[j]);
+            }
+            w.sim->runLanes(w.lanes.data());
+            for (uint64_t lane = 0; lane < SIM_BLOCK && base + lane < c.end; lane++) {
+                for (size_t j = 0; j < out.size(); j++) out[j] = w.sim->state(net.outputs[j], lane);
+                const uint64_t* lanes = w.lanes.data();
+                formatRow(buf, *c.table, [=](size_t j) {
+                    return (lanes[j * SIM_WORDS + lane / 64] >> (lane % 64)) & 1;
+                }, out.data());
+            }
+        }
+    }
+    // 各位独立、取1的概率为ones/256的64位随机数: 从低到高按概率的各二进制位与/或上一个均匀随机数
+    static uint64_t randomWord(std::mt19937_64& rng, uint32_t ones) {
+        if (ones == 0) return 0;
+        if (ones >= 256) return ~0ull;
+        uint64_t word = 0;
+        int low = __builtin_ctz(ones);
+        for (int b = low; b < 8; b++) word = (ones >> b) & 1 ? word | rng() : word & rng();
+        return word;
+    }
+    // 块长为2的幂且按块长对齐: 低位按格雷码顺序走遍, 相邻两行只差一个输入, 输出按自然顺序存入states
+    template <class Sim>
+    static void grayRows(const Chunk& c, Sim& sim, std::vector<STATE>& states) {
+        const SimNetlist& net = *c.table->net;
+        size_t outs = net.outputs.size();
+        std::vector<STATE> in(net.inputs.size());
+        for (size_t j = 0; j < in.size(); j++) in[j] = translate((c.begin >> j) & 1);
+        states.resize((c.end - c.begin) * outs);
+        for (uint64_t t = 0; t < c.end - c.begin; t++) {
+            uint64_t offset = t ^ (t >> 1);
+            if (t > 0) {
+                int j = __builtin_ctzll(t);
+                in[j] = in[j] == ZERO ? ONE : ZERO;
+            }
+            sim.update(in);
+            for (size_t j = 0; j < outs; j++) states[offset * outs + j] = sim.state(net.outputs[j]);
+        }
+    }
+    // bit(j)为本行输入j的取值
+    template <class Bit>
+    void formatRow(std::string& buf, const Table& t, Bit bit, const STATE* out) const {
+        size_t inputCount = t.net->inputs.size(), outputCount = t.net->outputs.size();
+        if (binary) {
+            size_t at = buf.size();
+            buf.append(t.rowBytes, '\0');
+            char* row = &buf[at];
+            if (!t.ones.empty()) {
+                for (size_t j = 0; j < inputCount; j++) row[j / 8] |= static_cast<char>(bit(j) << (j % 8));
+                row += (inputCount + 7) / 8;
+            }
+            for (size_t j = 0; j < outputCount; j++) row[j / 4] |= static_cast<char>(out[j] << (2 * (j % 4)));
+        } else if (markdown) {
+            buf += '|';
+            for (size_t j = 0; j < inputCount; j++) {
+                buf += ' ';
+                buf += static_cast<char>('0' + bit(j));
+                buf += " |";
+            }
+            for (size_t j = 0; j < outputCount; j++) {
+                buf += ' ';
+                buf += retranslate(out[j]);
+                buf += " |";
+            }
+            buf += '\n';
+        } else {
+            buf += "inputs: ";
+            for (size_t j = 0; j < inputCount; j++) {
+                buf += t.inputNames[j];
+                buf += static_cast<char>('0' + bit(j));
+                buf += '\t';
+            }
+            buf += "\noutputs: ";
+            for (size_t j = 0; j < outputCount; j++) {
+                buf += t.outputNames[j];
+                buf += retranslate(out[j]);
+                buf += '\t';
+            }
+            buf += "\n\n";
+        }
+    }
+
+    static void put32(std::string& s, uint32_t v) { s.append(reinterpret_cast<const char*>(&v), 4); }
+    static void put64(std::string& s, uint64_t v) { s.append(reinterpret_cast<const char*>(&v), 8); }
+    static void putName(std::string& s, const std::string& name) {
+        put32(s, static_cast<uint32_t>(name.size()));
+        s += name;
+    }
+
+    std::ostream& out;
+    bool markdown;
+    bool binary;
+    bool gray;
+    uint64_t sampleCount = 0;
+    uint64_t sampleSeed = 0;
+    std::map<std::string, double> sampleBias;
+    std::deque<Table> modules;
+    std::vector<Part> parts;
+    // 输出锥的子网表及其编译结果(cones()中生成)
+    std::deque<SimNetlist> coneNets;
+    std::deque<SimProgram> conePrograms;
+    std::deque<LevelNetlist> coneLevels;
+};
+
+void ModuleNode::simulate_all_to_file(std::ostream& file, unsigned threads) {
+    TableWriter table(file, TABLE_MARKDOWN);
+    table.module(this);
+    table.run(threads);
+}
+
+void ModuleNode::simulate_all(unsigned threads) {
+    TableWriter table(std::cout, TABLE_TEXT);
+    table.module(this);
+    table.run(threads);
+}
+
+// 读取二进制真值表(格式见TABLE_MAGIC): 只解析各表头, 行按需从映射中取出
+class TruthTableFile {
+public:
+    struct Table {
+        std::string module;
+        std::vector<std::string> inputs;
+        std::vector<std::string> outputs;
+        bool sampled;
+        uint32_t rowBytes;
+        uint64_t rows;
+        const unsigned char* data;
+
+        // 第row行输入j的取值(0/1)
+        int input(uint64_t row, size_t j) const {
+            if (!sampled) return j < 64 ? static_cast<int>((row >> j) & 1) : 0;
+            return (data[row * rowBytes + j / 8] >> (j % 8)) & 1;
+        }
+        STATE output(uint64_t row, size_t j) const {
+            const unsigned char* out = data + row * rowBytes + (sampled ? (inputs.size() + 7) / 8 : 0);
+            return static_cast<STATE>((out[j / 4] >> (2 * (j % 4))) & 3);
+        }
+    };
+    std::vector<Table> tables;
+
+    explicit TruthTableFile(const MappedFile& file) : data(file.data()), len(file.size()) {
+        if (len < 16 || std::memcmp(data, TABLE_MAGIC, sizeof(TABLE_MAGIC)) != 0 || read32(8) != TABLE_VERSION) {
+            throw std::runtime_error("Error:不是二进制真值表文件或版本不符");
+        }
+        pos = 16;
+        while (pos < len) {
+            Table t;
+            t.module = readName();
+            uint32_t inputs = read32(pos), outputs = read32(pos + 4), flags = read32(pos + 8);
+            t.rowBytes = read32(pos + 12);
+            t.rows = read64(pos + 16);
+            pos += 24;
+            t.sampled = flags & TABLE_SAMPLED;
+            for (uint32_t j = 0; j < inputs; j++) t.inputs.push_back(readName());
+            for (uint32_t j = 0; j < outputs; j++) t.outputs.push_back(readName());
+            if (t.rowBytes != (t.sampled ? (inputs + 7) / 8 : 0) + (outputs + 3) / 4 ||
+                t.rows > (len - pos) / std::max<uint32_t>(t.rowBytes, 1)) {
+                throw std::runtime_error("Error:二进制真值表" + t.module + "的表头与文件长度不符");
+            }
+            t.data = reinterpret_cast<const unsigned char*>(data + pos);
+            pos += t.rows * t.rowBytes;
+            tables.push_back(std::move(t));
+        }
+    }
+
+private:
+    uint32_t read32(size_t at) const {
+        check(at, 4);
+        uint32_t v;
+        std::memcpy(&v, data + at, 4);
+        return v;
+    }
+    uint64_t read64(size_t at) const {
+        check(at, 8);
+        uint64_t v;
+        std::memcpy(&v, data + at, 8);
+        return v;
+    }
+    std::string readName() {
+        uint32_t n = read32(pos);
+        check(pos + 4, n);
+        std::string name(data + pos + 4, n);
+        pos += 4 + n;
+        return name;
+    }
+    void check(size_t at, size_t n) const {
+        if (at > len || n > len - at) throw std::runtime_error("Error:二进制真值表文件不完整");
+    }
+
+    const char* data;
+    size_t len;
+    size_t pos = 0;
+};
+
+// 输出二进制真值表中[begin, end)行(超出的部分截去). module非空时只输出该模块的表(按输出锥分表时为多张).
+// json为真时输出一个json对象: {"tables": [{"module", "inputs", "outputs", "rows", "sampled", "begin",
+// "data": [[输入取值, 输出取值], ...]}]}, 取值为按端口顺序排列的0/1/Z/X字符串; 否则每行一组, 同-s
+void writeTableRows(const TruthTableFile& file, const std::string& module, uint64_t begin, uint64_t end, bool json,
+                    std::ostream& out) {
+    JsonWriter w(&out, -1);
+    if (json) {
+        w.beginObject();
+        w.key("tables");
+        w.beginArray();
+    }
+    std::string ins, outs, buf;
+    for (auto& t : file.tables) {
+        if (!module.empty() && t.module != module) continue;
+        uint64_t from = std::min(begin, t.rows), to = std::min(std::max(begin, end), t.rows);
+        if (json) {
+            w.beginObject();
+            w.key("module");
+            w.string(t.module);
+            for (auto* ports : {&t.inputs, &t.outputs}) {
+                w.key(ports == &t.inputs ? "inputs" : "outputs");
+                w.beginArray();
+                for (auto& name : *ports) w.string(name);
+                w.endArray();
+            }
+            w.key("rows");
+            w.raw(std::to_string(t.rows));
+            w.key("sampled");
+            w.raw(t.sampled ? "true" : "false");
+            w.key("begin");
+            w.raw(std::to_string(from));
+            w.key("data");
+            w.beginArray();
+        } else {
+            buf += "module " + t.module + " rows " + std::to_string(from) + ":" + std::to_string(to) + " of " +
+                   std::to_string(t.rows) + "\n";
+        }
+        for (uint64_t row = from; row < to; row++) {
+            ins.clear();
+            outs.clear();
+            for (size_t j = 0; j < t.inputs.size(); j++) ins += static_cast<char>('0' + t.input(row, j));
+            for (size_t j = 0; j < t.outputs.size(); j++) outs += retranslate(t.output(row, j));
+            if (json) {
+                w.beginArray();
+                w.string(ins);
+                w.string(outs);
+                w.endArray();
+            } else {
+                buf += "inputs: ";
+                for (size_t j = 0; j < ins.size(); j++) buf += t.inputs[j] + ": " + ins[j] + "\t";
+                buf += "\noutputs: ";
+                for (size_t j = 0; j < outs.size(); j++) buf += t.outputs[j] + ": " + outs[j] + "\t";
+                buf += "\n\n";
+                if (buf.size() >= (1 << 20)) {
+                    out << buf;
+                    buf.clear();
+                }
+            }
+        }
+        if (json) {
+            w.endArray();
+            w.endObject();
+        }
+    }
+    if (json) {
+        w.endArray();
+        w.endObject();
+        w.buffer() += '\n';
+    }
+    out << buf;
+}
+
+// 激励文件: 每组输入一行, 依次为各输入的取值(0/1/Z/X, 空白和逗号忽略, #或//到行尾为注释);
+// 或以STIMULUS_MAGIC开头的二进制位矩阵: magic, u32版本, u32输入数, u64行数, 之后每行ceil(输入数/8)字节,
+// 输入j为第j/8字节的第j%8位(低位在前). 文件以内存映射读入, 每SIM_BLOCK行仿真一次, 已读完的页随即释放,
+// 输出按批写出, 内存占用与行数无关. 输出文件每行依次为各输出的取值
+const char STIMULUS_MAGIC[8] = {'S', 'E', 'D', 'A', 'V', 'E', 'C', '\0'};
+const uint32_t STIMULUS_VERSION = 1;
+const size_t STIMULUS_HEADER = 24;
+
+class StimulusReader {
+public:
+    StimulusReader(MappedFile& file, size_t inputs) : file(file), data(file.data()), len(file.size()), inputs(inputs) {
+        binary = len >= STIMULUS_HEADER && std::memcmp(data, STIMULUS_MAGIC, sizeof(STIMULUS_MAGIC)) == 0;
+        if (binary) {
+            uint32_t version, count;
+            std::memcpy(&version, data + 8, 4);
+            std::memcpy(&count, data + 12, 4);
+            std::memcpy(&rows, data + 16, 8);
+            rowBytes = (inputs + 7) / 8;
+            if (version != STIMULUS_VERSION || count != inputs) {
+                throw std::runtime_error("Error:激励文件的版本或输入数(" + std::to_string(count) + ")与模块不符");
+            }
+            if (rows > (len - STIMULUS_HEADER) / std::max<size_t>(rowBytes, 1)) {
+                throw std::runtime_error("Error:激励文件长度不足" + std::to_string(rows) + "行");
+            }
+            pos = STIMULUS_HEADER;
+        }
+    }
+
+    // 读入最多SIM_BLOCK组输入到两个位平面(布局同SimVM::runPlanes), 返回读到的组数, 0表示结束
+    size_t next(std::vector<uint64_t>& zeros, std::vector<uint64_t>& ones) {
+        zeros.assign(inputs * SIM_WORDS, ~0ull);
+        ones.assign(inputs * SIM_WORDS, 0);
+        size_t lanes = 0;
+        if (binary) {
+            for (; lanes < SIM_BLOCK && done < rows; lanes++, done++, pos += rowBytes) {
+                const unsigned char* row = reinterpret_cast<const unsigned char*>(data + pos);
+                for (size_t j = 0; j < inputs; j++) {
+                    ones[j * SIM_WORDS + lanes / 64] |= static_cast<uint64_t>((row[j / 8] >> (j % 8)) & 1) << (lanes % 64);
+                }
+            }
+            for (size_t i = 0; i < ones.size(); i++) zeros[i] = ~ones[i];
+        } else {
+            for (; lanes < SIM_BLOCK; lanes++) {
+                if (!readLine(zeros, ones, lanes / 64, 1ull << (lanes % 64))) break;
+            }
+        }
+        file.release(pos);
+        return lanes;
+    }
+    bool isBinary() const { return binary; }
+
+private:
+    // 跳过空行和注释行, 读一行文本向量; 文件结束时返回false
+    bool readLine(std::vector<uint64_t>& zeros, std::vector<uint64_t>& ones, size_t word, uint64_t bit) {
+        // 字符分类: 0..3为STATE, 其余为分隔符/注释/换行/非法字符
+        enum : uint8_t { SKIP = 4, COMMENT, END, BAD };
+        static const std::array<uint8_t, 256> kind = [] {
+            std::array<uint8_t, 256> k;
+            k.fill(BAD);
+            k['0'] = ZERO;
+            k['1'] = ONE;
+            k['z'] = k['Z'] = Z;
+            k['x'] = k['X'] = X;
+            k[' '] = k['\t'] = k['\r'] = k[','] = SKIP;
+            k['#'] = k['/'] = COMMENT;
+            k['\n'] = END;
+            return k;
+        }();
+        while (pos < len) {
+            line++;
+            size_t j = 0;
+            for (; pos < len; pos++) {
+                uint8_t k = kind[static_cast<unsigned char>(data[pos])];
+                if (k < SKIP) {
+                    if (j == inputs) {
+                        j++;
+                        break;
+                    }
+                    // 可能为1: 1或X; 可能为0: 0或X
+                    size_t w = j * SIM_WORDS + word;
+                    ones[w] |= bit & (0 - static_cast<uint64_t>(k & 1));
+                    zeros[w] &= ~(bit & (0 - static_cast<uint64_t>((k ^ (k >> 1)) & 1)));
+                    j++;
+                } else if (k == SKIP) {
+                    continue;
+                } else if (k == COMMENT && (data[pos] == '#' || (pos + 1 < len && data[pos + 1] == '/'))) {
+                    while (pos < len && data[pos] != '\n') pos++;
+                    break;
+                } else if (k == END) {
+                    break;
+                } else {
+                    j = inputs + 1;
+                    break;
+                }
+            }
+            if (j > 0 && j != inputs) {
+                throw std::runtime_error("Error:激励文件第" + std::to_string(line) + "行的输入数或取值不正确");
+            }
+            pos++;
+            if (j == 0) continue;
+            return true;
+        }
+        return false;
+    }
+
+    MappedFile& file;
+    const char* data;
+    size_t len;
+    size_t inputs;
+    bool binary = false;
+    size_t pos = 0;
+    size_t line = 0;
+    uint64_t rows = 0, done = 0;
+    size_t rowBytes = 0;
+};
+
+// 用字节码仿真激励文件中的全部输入, 结果写到out, 返回仿真的组数
+uint64_t simulateStimulus(ModuleNode* m, MappedFile& file, std::ostream& out) {
+    const SimNetlist& net = m->compiled();
+    SimVM vm(net, m->bytecode());
+    StimulusReader reader(file, net.inputs.size());
+    std::vector<uint64_t> zeros, ones;
+    std::string buf = "#";
+    for (auto& p : m->outputs) buf += " " + symName(p->name);
+    buf += '\n';
+    const size_t FLUSH_BYTES = 1 << 20;
+    uint64_t total = 0;
+    size_t width = net.outputs.size() + 1;
+    while (size_t lanes = reader.next(zeros, ones)) {
+        vm.runPlanes(zeros.data(), ones.data());
+        size_t at = buf.size();
+        buf.resize(at + lanes * width);
+        char* row = &buf[at];
+        for (size_t lane = 0; lane < lanes; lane++, row += width) {
+            for (size_t j = 0; j < net.outputs.size(); j++) row[j] = "01ZX"[vm.state(net.outputs[j], lane)];
+            row[width - 1] = '\n';
+        }
+        total += lanes;
+        if (buf.size() >= FLUSH_BYTES) {
+            out.write(buf.data(), buf.size());
+            buf.clear();
+        }
+    }
+    out.write(buf.data(), buf.size());
+    return total;
+}
+
+// 比较各仿真引擎的速度: 每个引擎从第0行起按自然顺序仿真, 最多BENCH_VECTORS组输入或约BENCH_SECONDS秒
+void benchmarkEngines(ModuleNode* m, std::ostream& log) {
+    const uint64_t BENCH_VECTORS = 1 << 20;
+    const double BENCH_SECONDS = 0.5;
+    const SimNetlist& net = m->compiled();
+    size_t n = net.inputs.size();
+    uint64_t total = n < 63 ? std::min<uint64_t>(1ull << n, BENCH_VECTORS) : BENCH_VECTORS;
+    auto measure = [&](const char* engine, uint64_t step, auto run) {
+        auto start = std::chrono::steady_clock::now();
+        double secs = 0;
+        uint64_t done = 0;
+        while (done < total && secs < BENCH_SECONDS) {
+            run(done);
+            done += step;
+            secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        log << "  " << engine << ": " << std::min(done, total) << " vectors, "
+            << (secs > 0 ? std::min(done, total) / secs : 0) << " vectors/s\n";
+    };
+    log << "module " << symName(m->name) << " (" << net.mosfets.size() << " mosfets, " << n << " inputs)\n";
+    std::vector<STATE> in(n);
+    auto vector = [&](uint64_t row) {
+        for (size_t j = 0; j < n; j++) in[j] = translate(j < 64 ? (row >> j) & 1 : 0);
+        return in;
+    };
+    EventSim event(net);
+    measure("event", 1, [&](uint64_t row) { event.run(vector(row)); });
+    if (m->levelized().ok) {
+        LevelSim level(net, m->levelized());
+        measure("level", 1, [&](uint64_t row) { level.run(vector(row)); });
+    }
+    const MacroNetlist& macro = m->macroNetlist();
+    if (!macro.macros.empty()) {
+        MacroSim sim(net, macro);
+        measure("macro", 1, [&](uint64_t row) { sim.run(vector(row)); });
+        if (macro.level.ok) {
+            LevelSim level(net, macro.level);
+            measure("macro level", 1, [&](uint64_t row) { level.run(vector(row)); });
+        }
+        log << "  macro: " << macro.macros.size() << " instances (" << macro.absorbed << " mosfets), "
+            << macro.mosfets.size() << " mosfets at switch level\n";
+    }
+    BitSim bits(net);
+    measure("bitsim", SIM_BLOCK, [&](uint64_t row) { bits.runBlock(row); });
+    SimVM vm(net, m->bytecode());
+    measure("bytecode", SIM_BLOCK, [&](uint64_t row) { vm.runBlock(row); });
+    log << "  bytecode: " << m->bytecode().code.size() << " words, " << m->bytecode().gates.size() << " gates, "
+        << m->bytecode().loops << " loops\n";
+}
+
+// 门级识别的覆盖率: 识别为CMOS门的晶体管所占比例和各类门的数量, 其余晶体管按开关级仿真
+void reportGates(ModuleNode* m, std::ostream& log) {
+    const SimProgram& program = m->bytecode();
+    size_t total = m->compiled().mosfets.size(), covered = 0;
+    std::map<std::string, size_t> kinds;
+    for (auto& gate : program.gates) {
+        covered += gate.mosCount;
+        kinds[gate.kind]++;
+    }
+    log << "module " << symName(m->name) << ": " << total << " mosfets, " << covered << " in "
+        << program.gates.size() << " gates (" << std::fixed << std::setprecision(1)
+        << (total > 0 ? 100.0 * covered / total : 100.0) << "%)" << std::defaultfloat << "\n";
+    if (!kinds.empty()) {
+        log << " ";
+        for (auto& kind : kinds) log << " " << kind.first << " x " << kind.second;
+        log << "\n";
+    }
+    if (covered < total) log << "  switch level: " << total - covered << " mosfets\n";
+}
+
+// 符号仿真: 把BitSim中每个端口的两个位平面换成以输入为变量的BDD(zero[p]为端口p可能为0的输入组合,
+// one[p]为可能为1的), 方程和扫描方式与BitSim相同. 不动点对全部2^n组输入同时成立, 不需要逐行穷举
+class SymbolicSim {
+public:
+    // var[j]为输入j对应的BDD变量号
+    SymbolicSim(const SimNetlist& net, Bdd& bdd, const std::vector<uint32_t>& var)
+        : net(net), bdd(bdd), zero(net.portCount, Bdd::FALSE), one(net.portCount, Bdd::FALSE) {
+        if (net.vcc >= 0) one[net.vcc] = Bdd::TRUE;
+        if (net.gnd >= 0) zero[net.gnd] = Bdd::TRUE;
+        for (size_t j = 0; j < net.inputs.size(); j++) {
+            Bdd::Ref x = bdd.var(var[j]);
+            one[net.inputs[j]] = bdd.bor(one[net.inputs[j]], x);
+            zero[net.inputs[j]] = bdd.bor(zero[net.inputs[j]], bdd.bnot(x));
+        }
+        settle();
+    }
+    // 端口p取值为s的输入组合
+    Bdd::Ref is(uint32_t p, STATE s) {
+        switch (s) {
+            case ZERO: return bdd.band(zero[p], bdd.bnot(one[p]));
+            case ONE: return bdd.band(one[p], bdd.bnot(zero[p]));
+            case Z: return bdd.bnot(bdd.bor(zero[p], one[p]));
+            default: return bdd.band(zero[p], one[p]);
+        }
+    }
+    // 变量取值values下端口p的状态
+    STATE state(uint32_t p, const std::vector<uint8_t>& values) const {
+        bool z = bdd.eval(zero[p], values), o = bdd.eval(one[p], values);
+        return z ? (o ? X : ZERO) : (o ? ONE : Z);
+    }
+    Bdd::Ref zeroRail(uint32_t p) const { return zero[p]; }
+    Bdd::Ref oneRail(uint32_t p) const { return one[p]; }
+
+private:
+    void settle() {
+        std::vector<uint8_t> dirty(net.mosfets.size(), 1);
+        size_t pending = dirty.size();
+        while (pending > 0) {
+            for (uint32_t m : net.order) {
+                if (!dirty[m]) continue;
+                dirty[m] = 0;
+                pending--;
+                if (eval(net.mosfets[m])) {
+                    uint32_t d = net.mosfets[m].drain;
+                    for (uint32_t k = net.fanoutStart[d]; k < net.fanoutStart[d + 1]; k++) {
+                        uint32_t f = net.fanout[k];
+                        if (!dirty[f]) {
+                            dirty[f] = 1;
+                            pending++;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    bool eval(const SimNetlist::Mos& mos) {
+        Bdd::Ref on = mos.type == PMOS ? zero[mos.gate] : one[mos.gate];
+        Bdd::Ref off = mos.type == PMOS ? one[mos.gate] : zero[mos.gate];
+        Bdd::Ref n0 = bdd.bor(zero[mos.drain], bdd.band(on, bdd.bor(zero[mos.source], off)));
+        Bdd::Ref n1 = bdd.bor(one[mos.drain], bdd.band(on, bdd.bor(one[mos.source], off)));
+        bool changed = n0 != zero[mos.drain] || n1 != one[mos.drain];
+        zero[mos.drain] = n0;
+        one[mos.drain] = n1;
+        return changed;
+    }
+
+    const SimNetlist& net;
+    Bdd& bdd;
+    std::vector<Bdd::Ref> zero;
+    std::vector<Bdd::Ref> one;
+};
+
+// 变量顺序: 从各输出出发沿驱动晶体管深度优先向输入方向搜索, 输入按首次到达的先后编号.
+// 相互影响的输入因此排在相邻位置(如加法器的a_i, b_i), BDD通常小得多
+inline std::vector<uint32_t> symbolicOrder(const SimNetlist& net) {
+    std::vector<uint32_t> var(net.inputs.size(), UINT32_MAX);
+    std::vector<long long> inputOf(net.portCount, -1);
+    for (size_t j = 0; j < net.inputs.size(); j++) inputOf[net.inputs[j]] = static_cast<long long>(j);
+    std::vector<uint8_t> seen(net.portCount, 0);
+    uint32_t next = 0;
+    for (uint32_t o : net.outputs) {
+        std::vector<uint32_t> stack{o};
+        while (!stack.empty()) {
+            uint32_t p = stack.back();
+            stack.pop_back();
+            if (seen[p]) continue;
+            seen[p] = 1;
+            if (inputOf[p] >= 0 && var[inputOf[p]] == UINT32_MAX) var[inputOf[p]] = next++;
+            for (uint32_t k = net.driverStart[p + 1]; k-- > net.driverStart[p];) {
+                const SimNetlist::Mos& mos = net.mosfets[net.drivers[k]];
+                stack.push_back(mos.source);
+                stack.push_back(mos.gate);
+            }
+        }
+    }
+    for (auto& v : var) {
+        if (v == UINT32_MAX) v = next++;
+    }
+    return var;
+}
+
+inline std::string formatCount(double rows) {
+    if (rows < 9007199254740992.0) return std::to_string(static_cast<uint64_t>(rows));
+    std::ostringstream s;
+    s << std::setprecision(6) << rows;
+    return s.str();
+}
+
+// 符号模式(不穷举): 每个输出取0/1/Z/X的行数、BDD大小, 以及随机抽取的若干行
+void reportSymbolic(ModuleNode* m, std::ostream& log, size_t samples = 8) {
+    const SimNetlist& net = m->compiled();
+    size_t n = net.inputs.size();
+    log << "module " << symName(m->name) << " (" << n << " inputs)\n";
+    try {
+        Bdd bdd;
+        std::vector<uint32_t> var = symbolicOrder(net);
+        SymbolicSim sim(net, bdd, var);
+        for (size_t j = 0; j < net.outputs.size(); j++) {
+            uint32_t o = net.outputs[j];
+            log << "  " << symName(m->outputs[j]->name) << ":";
+            for (STATE s : {ZERO, ONE, Z, X}) {
+                double rows = bdd.satCount(sim.is(o, s), static_cast<uint32_t>(n));
+                if (rows > 0) log << " " << retranslate(s) << " in " << formatCount(rows) << " rows,";
+            }
+            log << " " << bdd.nodeCount(sim.zeroRail(o)) + bdd.nodeCount(sim.oneRail(o)) << " nodes\n";
+        }
+        log << "  " << bdd.size() << " BDD nodes in total\n";
+        // 行数不多于samples时按顺序列出全部行, 否则随机抽取(种子固定, 同一模块每次输出相同)
+        bool all = n < 63 && (1ull << n) <= samples;
+        if (all) samples = 1ull << n;
+        std::mt19937_64 rng(n);
+        std::vector<uint8_t> values(n);
+        for (size_t i = 0; i < samples; i++) {
+            log << "  inputs: ";
+            for (size_t j = 0; j < n; j++) {
+                values[var[j]] = all ? (i >> j) & 1 : rng() & 1;
+                log << symName(m->inputs[j]->name) << ": " << static_cast<int>(values[var[j]]) << "\t";
+            }
+            log << "\n  outputs: ";
+            for (size_t j = 0; j < net.outputs.size(); j++) {
+                log << symName(m->outputs[j]->name) << ": " << retranslate(sim.state(net.outputs[j], values)) << "\t";
+            }
+            log << "\n";
+        }
+    } catch (const std::runtime_error& e) {
+        log << "  " << e.what() << "\n";
+    }
+}
+
+// 两个模块的等价性检查: 输入按名称对应(名称不同而个数相同时按顺序), 输出同样.
+// 共用一个BDD管理器, 每个输出的两个位平面都相同时等价, 否则给出一个取值不同的输入组合
+bool checkEquivalence(ModuleNode* a, ModuleNode* b, std::ostream& log) {
+    const SimNetlist& na = a->compiled();
+    const SimNetlist& nb = b->compiled();
+    auto match = [](const std::vector<PortNode*>& x, const std::vector<PortNode*>& y, const char* what) {
+        std::vector<uint32_t> index(y.size());
+        std::unordered_map<Symbol, uint32_t> byName;
+        for (uint32_t i = 0; i < x.size(); i++) byName.emplace(x[i]->name, i);
+        bool named = x.size() == y.size();
+        for (uint32_t i = 0; i < y.size() && named; i++) {
+            auto it = byName.find(y[i]->name);
+            if (it == byName.end()) named = false;
+            else index[i] = it->second;
+        }
+        if (!named) {
+            if (x.size() != y.size()) throw std::runtime_error(std::string("Error:两个模块的") + what + "数量不同");
+            for (uint32_t i = 0; i < y.size(); i++) index[i] = i;
+        }
+        return index;
+    };
+    log << "module " << symName(a->name) << " vs " << symName(b->name) << ": ";
+    try {
+        std::vector<uint32_t> inputs = match(a->inputs, b->inputs, "输入");
+        std::vector<uint32_t> outputs = match(a->outputs, b->outputs, "输出");
+        Bdd bdd;
+        std::vector<uint32_t> varA = symbolicOrder(na), varB(inputs.size());
+        for (size_t i = 0; i < inputs.size(); i++) varB[i] = varA[inputs[i]];
+        SymbolicSim simA(na, bdd, varA);
+        SymbolicSim simB(nb, bdd, varB);
+        for (size_t i = 0; i < outputs.size(); i++) {
+            uint32_t oa = na.outputs[outputs[i]], ob = nb.outputs[i];
+            Bdd::Ref diff = bdd.bor(bdd.bxor(simA.zeroRail(oa), simB.zeroRail(ob)),
+                                    bdd.bxor(simA.oneRail(oa), simB.oneRail(ob)));
+            std::vector<uint8_t> values(varA.size(), 0);
+            if (!bdd.pick(diff, values)) continue;
+            log << "differ at " << symName(a->outputs[outputs[i]]->name) << "\n  inputs: ";
+            for (size_t j = 0; j < varA.size(); j++) {
+                log << symName(a->inputs[j]->name) << ": " << static_cast<int>(values[varA[j]]) << "\t";
+            }
+            log << "\n  outputs: " << symName(a->name) << ": " << retranslate(simA.state(oa, values)) << "\t"
+                << symName(b->name) << ": " << retranslate(simB.state(ob, values)) << "\n";
+            return false;
+        }
+        log << "equivalent (" << bdd.size() << " BDD nodes)\n";
+        return true;
+    } catch (const std::runtime_error& e) {
+        log << e.what() << "\n";
+        return false;
+    }
+}
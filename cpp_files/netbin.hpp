@@ -0,0 +1,226 @@
+#pragma once
+#include "mmap_file.hpp"
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// mos2json与TestRoute之间的二进制网表(.netbin), 内容与.v.json相同(每个模块展开后的端口、晶体管和实例)
+// 文件布局(小端): 文件头 + 8张连续的表, 每张表按8字节对齐
+//   字符串表: offsets[count+1](u64) + 字节(UTF-8, 无结尾符), 其余各表中的名称都是字符串编号
+//   模块表 ModuleRec, 端口表 PortRec, 晶体管表 MosRec, 实例表 InstRec
+//   fanout(u32): 端口in/out列表中的晶体管编号(晶体管表下标); params(u32): 实例参数的字符串编号
+namespace netbin {
+
+const char MAGIC[8] = {'S', 'E', 'D', 'A', 'N', 'E', 'T', '\0'};
+const uint32_t VERSION = 1;
+
+enum PortType : uint32_t { PORT_UNDEF, PORT_INPUT, PORT_OUTPUT, PORT_WIRE, PORT_POWER };
+enum MosType : uint32_t { MOS_PMOS, MOS_NMOS };
+
+// 各记录都只由u32字段组成, 区间以(first, count)表示
+struct ModuleRec { uint32_t name, firstPort, portCount, firstMos, mosCount, firstInst, instCount; };
+struct PortRec { uint32_t name, type, firstIn, inCount, firstOut, outCount; };
+struct MosRec { uint32_t name, type, drain, source, gate; };
+struct InstRec { uint32_t name, module, firstParam, paramCount; };
+
+enum Table { STRING_OFFSETS, STRING_BYTES, MODULES, PORTS, MOSFETS, INSTANCES, FANOUT, PARAMS, TABLE_COUNT };
+// 文件头: magic, version, 头长度, 每张表的(偏移, 元素个数)
+const size_t HEADER_SIZE = 16 + TABLE_COUNT * 16;
+
+inline const char* portTypeName(uint32_t type) {
+    switch (type) {
+        case PORT_INPUT: return "input";
+        case PORT_OUTPUT: return "output";
+        case PORT_WIRE: return "wire";
+        case PORT_POWER: return "power";
+    }
+    return "";
+}
+inline uint32_t portTypeCode(std::string_view type) {
+    if (type == "input") return PORT_INPUT;
+    if (type == "output") return PORT_OUTPUT;
+    if (type == "wire") return PORT_WIRE;
+    if (type == "power") return PORT_POWER;
+    return PORT_UNDEF;
+}
+inline const char* mosTypeName(uint32_t type) { return type == MOS_PMOS ? "pmos" : "nmos"; }
+
+// 文件开头是否为二进制网表的magic(用于和json文件区分)
+inline bool isNetbinFile(const std::string& path) {
+    std::ifstream f(path, std::ios::binary);
+    char magic[sizeof(MAGIC)];
+    return f.read(magic, sizeof(magic)) && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+// 按表追加记录后一次写出
+class Builder {
+public:
+    std::vector<ModuleRec> modules;
+    std::vector<PortRec> ports;
+    std::vector<MosRec> mosfets;
+    std::vector<InstRec> instances;
+    std::vector<uint32_t> fanout;
+    std::vector<uint32_t> params;
+
+    // 相同的字符串只存一份
+    uint32_t str(std::string_view s) {
+        auto it = ids.find(s);
+        if (it != ids.end()) return it->second;
+        uint32_t id = static_cast<uint32_t>(offsets.size());
+        offsets.push_back(bytes.size());
+        bytes.append(s.data(), s.size());
+        strings.emplace_back(s);
+        ids.emplace(strings.back(), id);
+        return id;
+    }
+
+    bool write(std::ostream& out) const {
+        std::vector<uint64_t> stringOffsets(offsets);
+        stringOffsets.push_back(bytes.size());
+        const void* data[TABLE_COUNT] = {stringOffsets.data(), bytes.data(), modules.data(), ports.data(),
+                                         mosfets.data(), instances.data(), fanout.data(), params.data()};
+        uint64_t counts[TABLE_COUNT] = {stringOffsets.size(), bytes.size(), modules.size(), ports.size(),
+                                        mosfets.size(), instances.size(), fanout.size(), params.size()};
+        size_t sizes[TABLE_COUNT] = {8, 1, sizeof(ModuleRec), sizeof(PortRec), sizeof(MosRec),
+                                     sizeof(InstRec), 4, 4};
+        std::string header(MAGIC, sizeof(MAGIC));
+        put32(header, VERSION);
+        put32(header, static_cast<uint32_t>(HEADER_SIZE));
+        uint64_t offset = HEADER_SIZE;
+        for (int t = 0; t < TABLE_COUNT; t++) {
+            put64(header, offset);
+            put64(header, counts[t]);
+            offset = align(offset + counts[t] * sizes[t]);
+        }
+        out.write(header.data(), header.size());
+        offset = HEADER_SIZE;
+        std::string buf;
+        for (int t = 0; t < TABLE_COUNT; t++) {
+            buf.clear();
+            const char* p = static_cast<const char*>(data[t]);
+            size_t len = counts[t] * sizes[t];
+            if (sizes[t] == 1) {
+                buf.assign(p, len);
+            } else if (sizes[t] == 8) {
+                for (size_t i = 0; i < counts[t]; i++) put64(buf, stringOffsets[i]);
+            } else {
+                // 记录均为u32数组
+                for (size_t i = 0; i < len; i += 4) {
+                    uint32_t v;
+                    std::memcpy(&v, p + i, 4);
+                    put32(buf, v);
+                }
+            }
+            buf.append(align(offset + len) - offset - len, '\0');
+            out.write(buf.data(), buf.size());
+            offset = align(offset + len);
+        }
+        return static_cast<bool>(out);
+    }
+
+private:
+    static uint64_t align(uint64_t v) { return (v + 7) & ~uint64_t(7); }
+    static void put32(std::string& s, uint32_t v) {
+        for (int i = 0; i < 4; i++) s.push_back(static_cast<char>(v >> (8 * i)));
+    }
+    static void put64(std::string& s, uint64_t v) {
+        for (int i = 0; i < 8; i++) s.push_back(static_cast<char>(v >> (8 * i)));
+    }
+
+    std::string bytes;
+    std::vector<uint64_t> offsets;
+    std::deque<std::string> strings;
+    std::unordered_map<std::string_view, uint32_t> ids;
+};
+
+// 直接在内存映射上读取, 打开时检查文件头与各表的范围; 越界的编号读到空记录/空字符串
+class View {
+public:
+    bool open(const std::string& path) {
+        if (!file.open(path)) return false;
+        base = reinterpret_cast<const unsigned char*>(file.data());
+        size_t size = file.size();
+        if (size < HEADER_SIZE || std::memcmp(base, MAGIC, sizeof(MAGIC)) != 0) return fail("不是二进制网表文件");
+        if (load32(base + 8) != VERSION) return fail("二进制网表版本不匹配");
+        size_t sizes[TABLE_COUNT] = {8, 1, sizeof(ModuleRec), sizeof(PortRec), sizeof(MosRec),
+                                     sizeof(InstRec), 4, 4};
+        for (int t = 0; t < TABLE_COUNT; t++) {
+            offset[t] = load64(base + 16 + t * 16);
+            count[t] = load64(base + 24 + t * 16);
+            if (offset[t] > size || count[t] > (size - offset[t]) / sizes[t]) return fail("二进制网表已损坏");
+        }
+        if (count[STRING_OFFSETS] == 0) return fail("二进制网表已损坏");
+        for (uint64_t i = 0; i < count[MODULES]; i++) {
+            ModuleRec m = module(i);
+            if (!inRange(m.firstPort, m.portCount, PORTS) ||
+                !inRange(m.firstMos, m.mosCount, MOSFETS) || !inRange(m.firstInst, m.instCount, INSTANCES)) {
+                return fail("二进制网表已损坏");
+            }
+        }
+        if (load64(base + offset[STRING_OFFSETS] + 8 * (count[STRING_OFFSETS] - 1)) > count[STRING_BYTES]) {
+            return fail("二进制网表已损坏");
+        }
+        index.clear();
+        for (uint32_t i = 0; i < moduleCount(); i++) {
+            index.emplace(str(module(i).name), i);
+        }
+        return true;
+    }
+    const std::string& error() const { return err; }
+
+    uint32_t moduleCount() const { return static_cast<uint32_t>(count[MODULES]); }
+    ModuleRec module(uint64_t i) const { return record<ModuleRec>(MODULES, i); }
+    PortRec port(uint64_t i) const { return record<PortRec>(PORTS, i); }
+    MosRec mos(uint64_t i) const { return record<MosRec>(MOSFETS, i); }
+    InstRec instance(uint64_t i) const { return record<InstRec>(INSTANCES, i); }
+    uint32_t fanout(uint64_t i) const { return i < count[FANOUT] ? load32(base + offset[FANOUT] + 4 * i) : 0; }
+    uint32_t param(uint64_t i) const { return i < count[PARAMS] ? load32(base + offset[PARAMS] + 4 * i) : 0; }
+    std::string_view str(uint32_t id) const {
+        if (uint64_t(id) + 1 >= count[STRING_OFFSETS]) return std::string_view();
+        const unsigned char* offs = base + offset[STRING_OFFSETS];
+        uint64_t b = load64(offs + 8 * uint64_t(id)), e = load64(offs + 8 * (uint64_t(id) + 1));
+        if (b > e || e > count[STRING_BYTES]) return std::string_view();
+        return std::string_view(reinterpret_cast<const char*>(base + offset[STRING_BYTES] + b), e - b);
+    }
+    // 按名称查找模块, 返回-1表示不存在
+    long long findModule(std::string_view name) const {
+        auto it = index.find(name);
+        return it != index.end() ? static_cast<long long>(it->second) : -1;
+    }
+
+private:
+    bool fail(const char* msg) {
+        err = msg;
+        file.close();
+        return false;
+    }
+    bool inRange(uint64_t first, uint64_t n, int table) const { return first <= count[table] && n <= count[table] - first; }
+    template <class T>
+    T record(int table, uint64_t i) const {
+        T r{};
+        if (i >= count[table]) return r;
+        uint32_t* fields = reinterpret_cast<uint32_t*>(&r);
+        const unsigned char* p = base + offset[table] + sizeof(T) * i;
+        for (size_t f = 0; f < sizeof(T) / 4; f++) fields[f] = load32(p + 4 * f);
+        return r;
+    }
+    static uint32_t load32(const unsigned char* p) {
+        return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+    }
+    static uint64_t load64(const unsigned char* p) { return uint64_t(load32(p)) | uint64_t(load32(p + 4)) << 32; }
+
+    MappedFile file;
+    const unsigned char* base = nullptr;
+    uint64_t offset[TABLE_COUNT] = {};
+    uint64_t count[TABLE_COUNT] = {};
+    std::unordered_map<std::string_view, uint32_t> index;
+    std::string err;
+};
+
+}  // namespace netbin